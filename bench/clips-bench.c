@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+/*
+    Times the clip store queries the timeline does on every draw, click and
+    pointer motion against a walk over all the clips, at 1k, 100k and 1M clips.
+    Each size is run again with a clip as long as the whole timeline at the
+    start, under all the others, the way a soundtrack or a background sits.
+
+    gcc -Wall -O2 -I.. clips-bench.c ../gtk_timeline_clips.c -o clips-bench `pkg-config glib-2.0 --cflags --libs`
+    ./clips-bench [-n queries] [clips...]
+*/
+
+#include <glib.h>
+#include "gtk_timeline_clips.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//A 1920 px wide viewport at zoom 1 shows about 80 s of the timeline
+#define VIEWPORT (80 * G_TIME_SPAN_SECOND)
+
+static const guint default_sizes[] = { 1000, 100000, 1000000 };
+
+static volatile guint sink;
+
+static void fill(ImgTimelineClipStore *store, guint n, gboolean long_clip, GRand *rand)
+{
+  gint64 start = 0, duration;
+  guint i;
+
+  if (long_clip)
+    gtk_timeline_clip_store_insert(store, 0, (gint64)n * 5 * G_TIME_SPAN_SECOND, NULL, 0);
+
+  //Slides of 1 to 5 s, now and then one overlapping the previous
+  for (i = 0; i < n; i++)
+  {
+    duration = g_rand_int_range(rand, 1, 6) * G_TIME_SPAN_SECOND;
+    gtk_timeline_clip_store_insert(store, start, duration, NULL, 0);
+    if (g_rand_int_range(rand, 0, 8) == 0)
+      start += duration / 2;
+    else
+      start += duration;
+  }
+}
+
+static gint linear_find(ImgTimelineClipStore *store, gint64 time)
+{
+  gint i;
+
+  for (i = store->len - 1; i >= 0; i--)
+    if (store->start[i] <= time && store->start[i] + store->duration[i] > time)
+      return i;
+  return -1;
+}
+
+static guint linear_query(ImgTimelineClipStore *store, gint64 start, gint64 end)
+{
+  guint i, n = 0;
+
+  for (i = 0; i < store->len; i++)
+    if (store->start[i] < end && store->start[i] + store->duration[i] > start)
+      n++;
+  return n;
+}
+
+static guint index_query(ImgTimelineClipStore *store, gint64 start, gint64 end)
+{
+  guint i, first, last, n = 0;
+
+  gtk_timeline_clip_store_query(store, start, end, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(store, i + 1, start, last))
+    n++;
+  return n;
+}
+
+static gdouble run(ImgTimelineClipStore *store, gint queries, gboolean range, gboolean linear)
+{
+  GRand *rand = g_rand_new_with_seed(42);
+  gint64 length, time, elapsed;
+  gint i;
+
+  length = store->start[store->len - 1] + store->duration[store->len - 1];
+  elapsed = g_get_monotonic_time();
+  for (i = 0; i < queries; i++)
+  {
+    time = (gint64)(g_rand_double(rand) * length);
+    if (range && linear)
+      sink += linear_query(store, time, time + VIEWPORT);
+    else if (range)
+      sink += index_query(store, time, time + VIEWPORT);
+    else if (linear)
+      sink += linear_find(store, time);
+    else
+      sink += gtk_timeline_clip_store_find(store, time);
+  }
+  elapsed = g_get_monotonic_time() - elapsed;
+  g_rand_free(rand);
+
+  return elapsed * 1000.0 / queries;
+}
+
+int main(int argc, char *argv[])
+{
+  ImgTimelineClipStore store;
+  GRand *rand;
+  guint *sizes = (guint *)default_sizes;
+  gint n_sizes = G_N_ELEMENTS(default_sizes);
+  gint queries = 100000, linear_queries, opt, s, long_clip;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if (opt == 'n')
+      queries = MAX(1, atoi(optarg));
+    else
+    {
+      g_printerr("usage: %s [-n queries] [clips...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    n_sizes = argc - optind;
+    sizes = g_new(guint, n_sizes);
+    for (s = 0; s < n_sizes; s++)
+      sizes[s] = MAX(1, atoi(argv[optind + s]));
+  }
+
+  g_print("%10s %5s %14s %14s %14s %14s\n", "clips", "long", "find ns", "linear ns", "range ns", "linear ns");
+  for (s = 0; s < n_sizes; s++)
+    for (long_clip = 0; long_clip < 2; long_clip++)
+    {
+      gtk_timeline_clip_store_init(&store);
+      rand = g_rand_new_with_seed(s);
+      fill(&store, sizes[s], long_clip, rand);
+      g_rand_free(rand);
+
+      //The walk over all the clips gets as many queries as it takes to be measurable
+      linear_queries = MAX(10, queries / MAX(1, sizes[s] / 1000));
+      g_print("%10u %5s %14.1f %14.1f %14.1f %14.1f\n", sizes[s], long_clip ? "yes" : "no",
+              run(&store, queries, FALSE, FALSE), run(&store, linear_queries, FALSE, TRUE),
+              run(&store, queries, TRUE, FALSE), run(&store, linear_queries, TRUE, TRUE));
+      gtk_timeline_clip_store_clear(&store);
+    }
+
+  if (sizes != default_sizes)
+    g_free(sizes);
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+/*
+    Compares the thumbnail decoders on decode time and peak memory. Every
+    file/decoder pair runs in its own process so that ru_maxrss is its own.
+
+    gcc -Wall -DHAVE_LIBJPEG -I.. thumbnail-bench.c ../gtk_timeline_thumbnail.c -o thumbnail-bench `pkg-config gtk+-3.0 --cflags --libs` -ljpeg
+    ./thumbnail-bench [-n iterations] [-s size] [files...]
+*/
+
+#include <gtk/gtk.h>
+#include "gtk_timeline_thumbnail.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static const gchar *default_files[] = { "landscape.jpg", "cappuccetto_rosso.jpg", "landscape_grass_river.jpg" };
+
+static const struct
+{
+  ImgThumbnailDecode method;
+  const gchar *name;
+} methods[] = {
+  { IMG_THUMBNAIL_DECODE_EXIF,        "exif" },
+  { IMG_THUMBNAIL_DECODE_JPEG_SCALED, "jpeg-scaled" },
+  { IMG_THUMBNAIL_DECODE_GDK_PIXBUF,  "gdk-pixbuf" },
+};
+
+static void run(const gchar *filename, gint m, gint iterations, gint size)
+{
+  struct rusage usage;
+  GdkPixbuf *pix;
+  gint64 start, elapsed;
+  gint i, width = 0, height = 0;
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; i++)
+  {
+    pix = gtk_timeline_thumbnail_decode(filename, size, methods[m].method);
+    if (pix == NULL)
+    {
+      g_print("%-28s %-12s %9s\n", filename, methods[m].name, "n/a");
+      return;
+    }
+    width = gdk_pixbuf_get_width(pix);
+    height = gdk_pixbuf_get_height(pix);
+    g_object_unref(pix);
+  }
+  elapsed = g_get_monotonic_time() - start;
+
+  getrusage(RUSAGE_SELF, &usage);
+  g_print("%-28s %-12s %4dx%-4d %9.2f %12ld\n", filename, methods[m].name, width, height,
+          elapsed / 1000.0 / iterations, usage.ru_maxrss);
+}
+
+int main(int argc, char *argv[])
+{
+  const gchar **files = default_files;
+  gint n_files = G_N_ELEMENTS(default_files);
+  gint iterations = 20, size = 128, opt, f, m;
+  pid_t pid;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1)
+  {
+    if (opt == 'n')
+      iterations = MAX(1, atoi(optarg));
+    else if (opt == 's')
+      size = MAX(1, atoi(optarg));
+    else
+    {
+      g_printerr("usage: %s [-n iterations] [-s size] [files...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    files = (const gchar **)argv + optind;
+    n_files = argc - optind;
+  }
+
+  g_print("%-28s %-12s %9s %9s %12s\n", "file", "decoder", "size", "ms/decode", "peak RSS KiB");
+  for (f = 0; f < n_files; f++)
+    for (m = 0; m < (gint)G_N_ELEMENTS(methods); m++)
+    {
+      fflush(stdout);
+      pid = fork();
+      if (pid == 0)
+      {
+        run(files[f], m, iterations, size);
+        fflush(stdout);
+        _exit(0);
+      }
+      waitpid(pid, NULL, 0);
+    }
+
+  return 0;
+}
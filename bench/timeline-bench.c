@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+/*
+    Times the timeline's frames scrolling over it, drawn into a cairo image
+    surface, no window is ever shown. GTK still needs a display to start,
+    run it under xvfb-run on a machine without one.
+
+    A frame on the main thread only paints the ruler and track tiles drawn
+    by the workers, so the time the workers spent on each tile is reported
+    on its own, from the timeline's stats. Next to them the percentiles of
+    the frame times and the allocations made on the main thread while
+    drawing a frame, counted by wrapping the glibc allocator.
+
+    cmake -S .. -B build && cmake --build build --target timeline-bench
+    ./timeline-bench [-t total_time] [-z pixels_per_second] [-n clips] [-f frames] [-w width] [image]
+*/
+
+#include <gtk/gtk.h>
+#include "gtk_timeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define HEIGHT 200
+
+//Frames drawn first and not counted, most thumbnails are decoded by then
+#define WARMUP_FRAMES 20
+
+static __thread gboolean counting;
+static guint64 allocations;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_realloc(p, size);
+}
+#endif
+
+static gint compare_doubles(gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble*)a, y = *(const gdouble*)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gdouble percentile(gdouble *sorted, gint n, gdouble p)
+{
+  return sorted[MIN(n - 1, (gint)(p * n))];
+}
+
+static void flush_events(void)
+{
+  while (gtk_events_pending())
+    gtk_main_iteration();
+}
+
+int main(int argc, char *argv[])
+{
+  GtkWidget *window, *scrolled, *timeline;
+  GtkAdjustment *adjustment;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  const gchar *image = "landscape.jpg";
+  gdouble pixels_per_second = 47.5, *times, *allocs, scroll, total_allocs = 0;
+  gint total_time = 300, clips = 150, frames = 500, width = 1920;
+  ImgTimelineStats stats;
+  gint64 start, duration, elapsed;
+  gint opt, i;
+
+  while ((opt = getopt(argc, argv, "t:z:n:f:w:")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': total_time = MAX(1, atoi(optarg)); break;
+      case 'z': pixels_per_second = g_ascii_strtod(optarg, NULL); break;
+      case 'n': clips = MAX(0, atoi(optarg)); break;
+      case 'f': frames = MAX(1, atoi(optarg)); break;
+      case 'w': width = MAX(1, atoi(optarg)); break;
+      default:
+        g_printerr("usage: %s [-t total_time] [-z pixels_per_second] [-n clips] [-f frames] [-w width] [image]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind < argc)
+    image = argv[optind];
+
+  //Older GLib hand out slices from their own magazines, count them too
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+  if ( ! gtk_init_check(&argc, &argv))
+  {
+    g_printerr("%s: no display, try xvfb-run %s\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  //The same widgets as the demo, in a window that is never mapped on screen
+  window = gtk_offscreen_window_new();
+  scrolled = gtk_scrolled_window_new(NULL, NULL);
+  timeline = gtk_timeline_new();
+  gtk_widget_set_size_request(scrolled, width, HEIGHT);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_ALWAYS, GTK_POLICY_NEVER);
+  gtk_container_add(GTK_CONTAINER(scrolled), timeline);
+  gtk_container_add(GTK_CONTAINER(window), scrolled);
+
+  g_object_set(timeline, "total_time", total_time, "video_background", "#0084ff", "audio_background", "#0084ff", NULL);
+  gtk_timeline_set_pixels_per_second((ImgTimeline*)timeline, pixels_per_second);
+  gtk_timeline_set_stats((ImgTimeline*)timeline, TRUE);
+
+  //The clips share the total time evenly, back to back
+  duration = MAX(1, (gint64)total_time * G_TIME_SPAN_SECOND / MAX(1, clips));
+  gtk_timeline_begin_update((ImgTimeline*)timeline);
+  for (i = 0, start = 0; i < clips; i++, start += duration)
+    gtk_timeline_insert_clip((ImgTimeline*)timeline, image, start, duration);
+  gtk_timeline_end_update((ImgTimeline*)timeline);
+
+  gtk_widget_show_all(window);
+  flush_events();
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, HEIGHT);
+  cr = cairo_create(surface);
+  adjustment = gtk_scrolled_window_get_hadjustment(GTK_SCROLLED_WINDOW(scrolled));
+  times = g_new(gdouble, frames);
+  allocs = g_new(gdouble, frames);
+
+  //One sweep from the start to the end of the timeline
+  for (i = -WARMUP_FRAMES; i < frames; i++)
+  {
+    scroll = (gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_page_size(adjustment)) * MAX(0, i) / MAX(1, frames - 1);
+    gtk_adjustment_set_value(adjustment, scroll);
+    flush_events();
+    if (i == 0)
+      gtk_timeline_reset_stats((ImgTimeline*)timeline);
+
+    allocations = 0;
+    counting = TRUE;
+    elapsed = g_get_monotonic_time();
+    gtk_widget_draw(scrolled, cr);
+    cairo_surface_flush(surface);
+    elapsed = g_get_monotonic_time() - elapsed;
+    counting = FALSE;
+
+    if (i >= 0)
+    {
+      times[i] = elapsed / 1000.0;
+      allocs[i] = allocations;
+      total_allocs += allocations;
+    }
+  }
+
+  //Let the workers finish the tiles of the last frames and hand them over
+  g_usleep(G_USEC_PER_SEC / 10);
+  flush_events();
+  gtk_timeline_get_stats((ImgTimeline*)timeline, &stats);
+
+  qsort(times, frames, sizeof(gdouble), (GCompareFunc)compare_doubles);
+  qsort(allocs, frames, sizeof(gdouble), (GCompareFunc)compare_doubles);
+  g_print("total_time %d s, %g px/s, %d clips, %d frames of %dx%d\n", total_time, pixels_per_second, clips, frames, width, HEIGHT);
+  g_print("frame ms     p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f\n",
+          percentile(times, frames, 0.5), percentile(times, frames, 0.9), percentile(times, frames, 0.99), times[frames - 1]);
+  g_print("tile ms      p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f  %" G_GUINT64_FORMAT " tiles, on the workers\n",
+          gtk_timeline_histogram_percentile(&stats.tile_render, 0.5) / 1000.0, gtk_timeline_histogram_percentile(&stats.tile_render, 0.9) / 1000.0,
+          gtk_timeline_histogram_percentile(&stats.tile_render, 0.99) / 1000.0, stats.tile_render.max / 1000.0, stats.tile_render.count);
+#ifdef __GLIBC__
+  g_print("allocations  p50 %8.0f  p90 %8.0f  p99 %8.0f  max %8.0f  mean %.1f\n",
+          percentile(allocs, frames, 0.5), percentile(allocs, frames, 0.9), percentile(allocs, frames, 0.99), allocs[frames - 1], total_allocs / frames);
+#endif
+
+  g_free(times);
+  g_free(allocs);
+  cairo_destroy(cr);
+  cairo_surface_destroy(surface);
+  gtk_widget_destroy(window);
+  return 0;
+}
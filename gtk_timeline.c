@@ -17,15 +17,230 @@
  *
  */
 #include "gtk_timeline.h"
+#include "gtk_timeline_thumbnail.h"
+#include "gtk_timeline_clips.h"
+#include "gtk_timeline_audio.h"
+#include <math.h>
 
 /**
- * ImgTimeline is a GTK+3 custom widget based on GtkLayout 
+ * ImgTimeline is a GTK+3 custom widget based on GtkDrawingArea
     which aims to build a nice and customizable timeline widget
  *
+ * It is only as wide as what can be seen and scrolls itself as a
+ * GtkScrollable, put it straight in a GtkScrolledWindow. Everything is
+ * laid out in timeline pixels, time_to_x() of the time, and drawn
+ * translated by the offset of the time at the left edge
  */
 
 #define GTK_TIMELINE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), GTK_TIMELINE_TYPE, ImgTimelinePrivate))
 
+//Half the width of a "00:00:00:00" label, ticks this far out of the clip still show part of it
+#define LABEL_HALF_WIDTH 40
+
+//The zoom is a scale in pixels per second, from a 3 hours overview in a
+//window to frames wide enough to click
+#define MIN_PIXELS_PER_SECOND     0.05
+#define MAX_PIXELS_PER_SECOND     2000.0
+#define DEFAULT_PIXELS_PER_SECOND 47.5
+//How much a notch of the mouse wheel zooms
+#define ZOOM_STEP 1.25
+
+//The ruler counts frames at this rate until the timeline knows the one of the slideshow
+#define DEFAULT_FRAME_RATE_NUM 25
+#define DEFAULT_FRAME_RATE_DEN 1
+//Ticks and labels closer than this are skipped for the next level of detail
+#define TICK_MIN_DISTANCE  12
+#define LABEL_MIN_DISTANCE 100
+
+//The ruler and the track backgrounds are drawn by the tile workers into
+//TILE_SLOTS tiles, tile n lives in slot n % TILE_SLOTS
+#define TILE_WIDTH  256
+#define TILE_HEIGHT 176
+#define TILE_SLOTS  32
+//No more tile workers than this, whatever the number of cores
+#define TILE_MAX_THREADS 8
+
+//The ruler labels are made of these chars only, LABEL_COLON is the index of ':'
+#define LABEL_CHARS         "0123456789:"
+#define LABEL_N_CHARS       11
+#define LABEL_COLON         10
+#define LABEL_MAX_GLYPHS    16
+#define LABEL_GLYPH_BATCH   512
+
+//How many decoded thumbnails are handed to their clips per main loop iteration
+#define DECODE_BATCH 32
+
+//The slides are painted by the timeline itself on the video track
+#define SLIDE_Y       43
+#define SLIDE_WIDTH   95
+#define SLIDE_HEIGHT  60
+#define SLIDE_PADDING 5
+//The pointer this close to the right edge of a slide gets the resize cursor
+#define SLIDE_EDGE    5
+//Each thumbnail is kept at the slide height and halved MIP_LEVELS - 1 times:
+//50, 25 and 12 px high
+#define MIP_LEVELS 3
+//Clips wide enough for two thumbnails show a filmstrip of them this far apart
+#define FILMSTRIP_GAP 4
+
+//The decoded thumbnails may take this much memory by default
+#define DEFAULT_CACHE_BUDGET (64 * 1024 * 1024)
+
+//How long a slide added without a duration lasts
+#define SLIDE_DURATION (2 * G_TIME_SPAN_SECOND)
+
+//The audio clips and their waveform inside the audio track
+#define AUDIO_Y      113
+#define AUDIO_HEIGHT 62
+
+//The red time marker, as drawn by gtk_timeline_draw_time_marker(), and the
+//pixel its 2 px stroke spills over on every side
+#define MARKER_Y      17
+#define MARKER_WIDTH  10
+#define MARKER_HEIGHT 159
+#define MARKER_SPILL  1
+
+//Pressing the ruler in this band starts scrubbing the time marker
+#define SCRUB_Y1 16
+#define SCRUB_Y2 32
+
+//How long the debug_damage overlay stays on the repainted areas, in ms
+#define FLASH_TIME 150
+
+//The stats overlay in the top right corner of the page, refreshed this often in ms
+#define STATS_WIDTH   330
+#define STATS_HEIGHT  124
+#define STATS_LINE    12
+#define STATS_REFRESH 500
+
+//Flags of the clips in the clip store, the dragged ones are drawn
+//priv->drag_delta away from their start until the drop
+enum
+{
+  CLIP_SELECTED = 1 << 0,
+  CLIP_DRAGGED  = 1 << 1
+};
+
+//Cursors made once per realize
+enum
+{
+  CURSOR_DEFAULT,
+  CURSOR_EDGE,
+  CURSOR_DRAG,
+  CURSOR_N
+};
+
+enum
+{
+  THUMB_LOADING = 1 << 0,
+  THUMB_MISSING = 1 << 1
+};
+
+//The image of a clip, the clip store only keeps a pointer to it so it stays
+//put while the clips are sorted around. filmstrip repeats a tile made of
+//mip[0] and a gap, it's made the first time a long clip is drawn.
+//The surfaces are decoded when the clip is first drawn and, while they are
+//there, lru_link is in priv->lru and bytes is what they take
+typedef struct _ImgTimelineThumb ImgTimelineThumb;
+
+struct _ImgTimelineThumb
+{
+  gchar *filename;
+  guint flags;
+  cairo_surface_t *mip[MIP_LEVELS];
+  gint width[MIP_LEVELS];
+  gint height[MIP_LEVELS];
+  cairo_pattern_t *filmstrip;
+  GCancellable *cancellable;
+  GList lru_link;
+  gsize bytes;
+  guint visible_serial;
+};
+
+//An audio clip, its peaks are mapped from their peak file or reduced on the
+//decode workers as soon as it's added and kept for good, they are a few MB
+//for hours of sound
+typedef struct _ImgTimelineAudio ImgTimelineAudio;
+
+struct _ImgTimelineAudio
+{
+  gchar *filename;
+  guint flags;
+  ImgTimelinePeaks *peaks;
+  GCancellable *cancellable;
+};
+
+//Either a thumbnail or, when audio is set, the peaks of an audio clip
+typedef struct _ImgTimelineDecodeJob ImgTimelineDecodeJob;
+
+struct _ImgTimelineDecodeJob
+{
+  ImgTimeline *timeline;
+  ImgTimelineThumb *thumb;
+  ImgTimelineAudio *audio;
+  gchar *filename;
+  GCancellable *cancellable;
+  GdkPixbuf *pix[MIP_LEVELS];
+  ImgTimelinePeaks *peaks;
+  gint64 queued;
+};
+
+//The glyphs of LABEL_CHARS to assemble the ruler labels with, left alone
+//once made so that the tile workers can share them
+typedef struct _ImgTimelineLabels ImgTimelineLabels;
+
+struct _ImgTimelineLabels
+{
+  cairo_scaled_font_t *font;
+  gulong glyph[LABEL_N_CHARS];
+  gdouble advance[LABEL_N_CHARS];
+  gboolean ready;
+};
+
+//What the ruler and the track backgrounds are drawn from, a copy is handed
+//to the tile workers so that they never look at the widget
+typedef struct _ImgTimelineBackground ImgTimelineBackground;
+
+struct _ImgTimelineBackground
+{
+  gdouble pixels_per_second;
+  gint64 duration;
+  gint frame_rate_num;
+  gint frame_rate_den;
+  gint width;
+  gdouble video_background[4];
+  gdouble audio_background[4];
+  ImgTimelineLabels labels;
+};
+
+//A slot of the tile cache. surface is the last tile drawn in it, still
+//good as a stand-in once serial is old. queued is the one being drawn
+typedef struct _ImgTimelineTile ImgTimelineTile;
+
+struct _ImgTimelineTile
+{
+  cairo_surface_t *surface;
+  gint index;
+  gint serial;
+  gdouble pixels_per_second;
+  gint queued;
+  gint queued_serial;
+};
+
+typedef struct _ImgTimelineTileJob ImgTimelineTileJob;
+
+struct _ImgTimelineTileJob
+{
+  ImgTimeline *timeline;
+  gint tile;
+  gint serial;
+  ImgTimelineBackground background;
+  cairo_surface_t *surface;
+  gboolean drawn;
+  //How long the worker took to draw it
+  gint64 render_time;
+};
+
 typedef struct _ImgTimelinePrivate ImgTimelinePrivate;
 
 struct _ImgTimelinePrivate
@@ -36,35 +251,188 @@ struct _ImgTimelinePrivate
   gdouble video_background[4];
   gdouble audio_background[4];
   
-  gint last_slide_posX;
-  gint zoom;
-  gint seconds;
-  gint minutes;
-  gint hours;
-  gint total_time;
-  gint time_marker_pos;
-  gboolean button_pressed;
-
-  cairo_surface_t *surface;
-  GtkWidget *slide_selected;
+  gdouble pixels_per_second;
+  //Microseconds, like the clips
+  gint64 duration;
+  gint64 time_marker;
+  gint frame_rate_num;
+  gint frame_rate_den;
+
+  //The time at the left edge drives the hadjustment, which is in timeline
+  //pixels, so that zooming doesn't drift
+  gint64 scroll_time;
+  GtkAdjustment *hadjustment;
+  GtkAdjustment *vadjustment;
+  guint hscroll_policy : 1;
+  guint vscroll_policy : 1;
+
+  //The tiles are drawn off the main thread, tiles_serial is bumped whenever
+  //they go stale and is read by the workers to skip the stale jobs
+  ImgTimelineTile tiles[TILE_SLOTS];
+  gint tiles_width;
+  gint tiles_serial;
+  GThreadPool *tile_pool;
+  GMutex tile_lock;
+  GPtrArray *tiled;
+  guint tile_idle;
+
+  ImgTimelineLabels labels;
+
+  //Clips sorted by start, changes made between begin and end_update are
+  //notified once
+  ImgTimelineClipStore clips;
+  ImgTimelineClipStore audio_clips;
+  gint update_depth;
+
+  //The clip pressed and, like for the scrubbing, where the pointer went
+  //since the last frame. The extent of the dragged clips is drag_start to
+  //drag_end before they are moved
+  gint drag_clip;
+  gdouble drag_x;
+  gdouble drag_pointer_x;
+  gboolean drag_pending;
+  gboolean drag_moved;
+  gint64 drag_delta;
+  gint64 drag_start;
+  gint64 drag_end;
+
+  GdkCursor *cursors[CURSOR_N];
+  gint cursor;
+
+  //Set by gtk_timeline_render_strips(), which draws off the page
+  gboolean exporting;
+
+  //Areas flashed by debug_damage and the ones being repainted to clear them
+  gboolean debug_damage;
+  cairo_region_t *flash;
+  cairo_region_t *flash_clear;
+  guint flash_timeout;
+
+  //Thumbnail decoding
+  GThreadPool *decode_pool;
+  gint decode_threads;
+  GCancellable *decode_cancellable;
+  GMutex decode_lock;
+  GPtrArray *decoded;
+  guint decode_idle;
+
+  //Decoded thumbnails, least recently drawn first
+  GQueue lru;
+  guint64 cache_budget;
+  guint64 cache_bytes;
+  guint64 cache_hits;
+  guint64 cache_misses;
+  guint64 cache_evictions;
+  guint visible_serial;
+
+  //Scrubbing, the last pointer x is applied once per frame by gtk_timeline_tick
+  gboolean scrubbing;
+  gboolean scrub_pending;
+  gdouble scrub_x;
+  guint tick;
+
+  //Instrumentation, nothing is timed unless stats is set
+  gboolean stats_enabled;
+  gboolean stats_overlay;
+  guint stats_timeout;
+  ImgTimelineStats stats;
 };
 
-gint offsetX, X1, oldx1 = 10, oldy1 = 20;
-
 //Private functions.
 static void gtk_timeline_class_init(ImgTimelineClass *klass);
 static void gtk_timeline_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
 static void gtk_timeline_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
 static void gtk_timeline_init(ImgTimeline *da);
 static gboolean gtk_timeline_draw(GtkWidget *widget, cairo_t *cr);
-static void gtk_timeline_draw_time_ticks(GtkWidget *widget, cairo_t *cr, gint width);
+static void gtk_timeline_draw_time_ticks(const ImgTimelineBackground *background, cairo_t *cr);
+static void gtk_timeline_cache_label_glyphs(ImgTimelineLabels *labels, cairo_t *cr);
+static void gtk_timeline_get_visible_range(GtkWidget *widget, cairo_t *cr, gdouble *x1, gdouble *x2);
+static gint64 gtk_timeline_get_tick_step(gdouble pixels_per_frame, gint rate, gdouble min_distance, gint64 multiple_of);
+static void gtk_timeline_size_allocate(GtkWidget *widget, GtkAllocation *allocation);
+static void gtk_timeline_set_hadjustment(ImgTimeline *da, GtkAdjustment *adjustment);
+static void gtk_timeline_set_vadjustment(ImgTimeline *da, GtkAdjustment *adjustment);
+static void gtk_timeline_configure_hadjustment(ImgTimeline *da);
+static void gtk_timeline_hadjustment_changed(GtkAdjustment *adjustment, ImgTimeline *da);
+static gdouble gtk_timeline_get_offset(ImgTimelinePrivate *priv);
+static gint gtk_timeline_get_width(GtkWidget *widget);
+static void gtk_timeline_queue_draw_span(GtkWidget *widget, gdouble x1, gdouble x2, gint y, gint height);
+static void gtk_timeline_draw_background(const ImgTimelineBackground *background, cairo_t *cr);
+static void gtk_timeline_draw_tracks(const ImgTimelineBackground *background, cairo_t *cr);
+static void gtk_timeline_clip_span(cairo_t *cr, gint *x, gint *width);
+static void gtk_timeline_get_background(ImgTimelinePrivate *priv, gint width, ImgTimelineBackground *background);
+static void gtk_timeline_draw_stand_in(GtkWidget *widget, cairo_t *cr, const ImgTimelineBackground *background, gint tile);
+static void gtk_timeline_queue_tile(GtkWidget *widget, const ImgTimelineBackground *background, gint tile);
+static void gtk_timeline_tile_thread(gpointer data, gpointer user_data);
+static gboolean gtk_timeline_tile_flush(gpointer data);
+static void gtk_timeline_tile_job_free(ImgTimelineTileJob *job);
+static void gtk_timeline_render_strip(GtkWidget *widget, cairo_surface_t *surface, const ImgTimelineBackground *background, gint x);
+static void gtk_timeline_export_load(ImgTimeline *da, gint64 start, gint64 end, GCancellable *cancellable);
+static void gtk_timeline_draw_tiles(GtkWidget *widget, cairo_t *cr, gint width);
+static void gtk_timeline_invalidate_tiles(ImgTimeline *da);
+static void gtk_timeline_get_page(GtkWidget *widget, gdouble *x1, gdouble *x2);
+static void gtk_timeline_queue_draw_visible(GtkWidget *widget);
+static void gtk_timeline_queue_draw_marker(GtkWidget *widget, gint posx);
+static void gtk_timeline_flash_damage(GtkWidget *widget, cairo_t *cr);
+static gboolean gtk_timeline_flash_timeout(gpointer data);
+static gint64 gtk_timeline_stats_phase(ImgTimelinePrivate *priv, ImgTimelinePhase phase, gint64 since);
+static void gtk_timeline_stats_add(ImgTimelineHistogram *histogram, guint64 value);
+static void gtk_timeline_stats_push(ImgTimeline *da, ImgTimelineDecodeJob *job);
+static void gtk_timeline_draw_stats(GtkWidget *widget, cairo_t *cr);
+static gboolean gtk_timeline_stats_timeout(gpointer data);
 static void gtk_timeline_finalize(GObject *object);
-static void gtk_timeline_drag_data_get(GtkWidget *widget, GdkDragContext *drag_context, GtkSelectionData *data, guint info, guint time,
-gpointer user_data);
-static gboolean gtk_timeline_slide_motion_notify(GtkWidget *button, GdkEventMotion *event, ImgTimeline *timeline);
-static gboolean gtk_timeline_slide_leave_event (GtkWidget *button, GdkEventCrossing *event, gpointer data);
+static void gtk_timeline_decode_thread(gpointer data, gpointer user_data);
+static gboolean gtk_timeline_decode_flush(gpointer data);
+static void gtk_timeline_decode_job_free(ImgTimelineDecodeJob *job);
+static void gtk_timeline_thumb_scale(GdkPixbuf **pix);
+static void gtk_timeline_thumb_set(ImgTimeline *da, ImgTimelineThumb *thumb, GdkPixbuf **pix);
+static ImgTimelineThumb *gtk_timeline_thumb_new(const gchar *filename);
+static void gtk_timeline_thumb_free(ImgTimeline *da, ImgTimelineThumb *thumb);
+static void gtk_timeline_thumb_request(ImgTimeline *da, ImgTimelineThumb *thumb);
+static void gtk_timeline_thumb_evict(ImgTimeline *da, ImgTimelineThumb *thumb);
+static void gtk_timeline_cache_trim(ImgTimeline *da);
+static void gtk_timeline_cache_mark_visible(ImgTimeline *da, gdouble x1, gdouble x2, gint64 offset, gboolean dragged);
+static void gtk_timeline_clips_changed(ImgTimeline *da);
+static gdouble gtk_timeline_time_to_x(ImgTimelinePrivate *priv, gint64 time);
+static gint64 gtk_timeline_x_to_time(ImgTimelinePrivate *priv, gdouble x);
+static gint64 gtk_timeline_frame_at(gint64 time, gint frame_rate_num, gint frame_rate_den);
+static gint64 gtk_timeline_frame_start(gint64 frame, gint frame_rate_num, gint frame_rate_den);
+static gint gtk_timeline_timecode_rate(gint frame_rate_num, gint frame_rate_den);
+static gint gtk_timeline_get_marker_x(ImgTimelinePrivate *priv);
+static void gtk_timeline_set_time_marker_x(ImgTimeline *da, gint posx);
+static gint64 gtk_timeline_snap_to_frame(ImgTimelinePrivate *priv, gint64 time);
+static void gtk_timeline_get_clip_extents(ImgTimelinePrivate *priv, guint index, gint *x, gint *width);
+static void gtk_timeline_draw_slides(GtkWidget *widget, cairo_t *cr);
+static void gtk_timeline_draw_clip_range(GtkWidget *widget, cairo_t *cr, gdouble x1, gdouble x2, gint64 offset, gboolean dragged);
+static void gtk_timeline_draw_slide(ImgTimeline *da, cairo_t *cr, ImgTimelineThumb *thumb, guint32 flags, gint x, gint width);
+static void gtk_timeline_draw_filmstrip(ImgTimeline *da, cairo_t *cr, ImgTimelineThumb *thumb, gint x, gint y, gint width, gint height);
+static void gtk_timeline_draw_audio(GtkWidget *widget, cairo_t *cr);
+static void gtk_timeline_draw_waveform(ImgTimelinePrivate *priv, cairo_t *cr, ImgTimelinePeaks *peaks, gint x, gint from, gint to);
+static void gtk_timeline_audio_free(ImgTimelineAudio *audio);
+static gint gtk_timeline_slide_at(ImgTimelinePrivate *priv, gdouble x, gdouble y);
+static gboolean gtk_timeline_button_press_event(GtkWidget *widget, GdkEventButton *event);
+static gboolean gtk_timeline_button_release_event(GtkWidget *widget, GdkEventButton *event);
+static gboolean gtk_timeline_motion_notify_event(GtkWidget *widget, GdkEventMotion *event);
+static gboolean gtk_timeline_leave_notify_event(GtkWidget *widget, GdkEventCrossing *event);
+static void gtk_timeline_realize(GtkWidget *widget);
+static void gtk_timeline_unrealize(GtkWidget *widget);
+static void gtk_timeline_set_cursor(GtkWidget *widget, gint cursor);
+static void gtk_timeline_scrub_to(GtkWidget *widget, gdouble x);
+static void gtk_timeline_queue_tick(GtkWidget *widget);
+static gboolean gtk_timeline_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data);
+static void gtk_timeline_drag_update(GtkWidget *widget);
+static void gtk_timeline_queue_draw_drag(GtkWidget *widget);
+
+enum
+{
+  CHANGED,
+  SCRUB,
+  LAST_SIGNAL
+};
+
+static guint timeline_signals[LAST_SIGNAL] = { 0 };
 
-G_DEFINE_TYPE_WITH_CODE (ImgTimeline, gtk_timeline, GTK_TYPE_LAYOUT, G_ADD_PRIVATE (ImgTimeline))
+G_DEFINE_TYPE_WITH_CODE (ImgTimeline, gtk_timeline, GTK_TYPE_DRAWING_AREA, G_ADD_PRIVATE (ImgTimeline)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL))
 
 static void gtk_timeline_class_init(ImgTimelineClass *klass)
 {
@@ -81,16 +449,48 @@ static void gtk_timeline_class_init(ImgTimelineClass *klass)
   //Draw when first shown.
   widget_class->draw = gtk_timeline_draw;
   gobject_class->finalize = gtk_timeline_finalize;
+
+  //The slides are hit-tested and dragged by the timeline itself
+  widget_class->button_press_event = gtk_timeline_button_press_event;
+  widget_class->button_release_event = gtk_timeline_button_release_event;
+  widget_class->motion_notify_event = gtk_timeline_motion_notify_event;
+  widget_class->leave_notify_event = gtk_timeline_leave_notify_event;
+  widget_class->realize = gtk_timeline_realize;
+  widget_class->unrealize = gtk_timeline_unrealize;
+  widget_class->size_allocate = gtk_timeline_size_allocate;
  
   g_object_class_install_property(gobject_class, VIDEO_BACKGROUND, g_param_spec_string("video_background", "video_background", "video_background", NULL, G_PARAM_READWRITE));
   g_object_class_install_property(gobject_class, AUDIO_BACKGROUND, g_param_spec_string("audio_background", "audio_background", "audio_background", NULL, G_PARAM_READWRITE));
   g_object_class_install_property(gobject_class, TOTAL_TIME,       g_param_spec_int("total_time", "total_time", "total_time", -1, G_MAXINT, 60, G_PARAM_READWRITE));
-  g_object_class_install_property(gobject_class, TIME_MARKER_POS, g_param_spec_int("time_marker_pos", "time_marker_pos", "time_marker_pos", -1, G_MAXINT, 0, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, DURATION,        g_param_spec_int64("duration", "duration", "duration", 0, G_MAXINT64, 60 * G_TIME_SPAN_SECOND, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, TIME_MARKER_POS, g_param_spec_int("time_marker_pos", "time_marker_pos", "time_marker_pos", -1, G_MAXINT, 0, G_PARAM_READWRITE | G_PARAM_DEPRECATED));
+  g_object_class_install_property(gobject_class, TIME_MARKER,     g_param_spec_int64("time_marker", "time_marker", "time_marker", 0, G_MAXINT64, 0, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, FRAME_RATE_NUM,  g_param_spec_int("frame_rate_num", "frame_rate_num", "frame_rate_num", 1, G_MAXINT, DEFAULT_FRAME_RATE_NUM, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, FRAME_RATE_DEN,  g_param_spec_int("frame_rate_den", "frame_rate_den", "frame_rate_den", 1, G_MAXINT, DEFAULT_FRAME_RATE_DEN, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, DECODE_THREADS,  g_param_spec_int("decode_threads", "decode_threads", "decode_threads", 1, 64, 4, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, PIXELS_PER_SECOND, g_param_spec_double("pixels_per_second", "pixels_per_second", "pixels_per_second", MIN_PIXELS_PER_SECOND, MAX_PIXELS_PER_SECOND, DEFAULT_PIXELS_PER_SECOND, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, CACHE_BUDGET,    g_param_spec_uint64("cache_budget", "cache_budget", "cache_budget", 0, G_MAXUINT64, DEFAULT_CACHE_BUDGET, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, DEBUG_DAMAGE,    g_param_spec_boolean("debug_damage", "debug_damage", "debug_damage", FALSE, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, STATS,           g_param_spec_boolean("stats", "stats", "stats", FALSE, G_PARAM_READWRITE));
+  g_object_class_install_property(gobject_class, STATS_OVERLAY,   g_param_spec_boolean("stats_overlay", "stats_overlay", "stats_overlay", FALSE, G_PARAM_READWRITE));
+  g_object_class_override_property(gobject_class, HADJUSTMENT,    "hadjustment");
+  g_object_class_override_property(gobject_class, VADJUSTMENT,    "vadjustment");
+  g_object_class_override_property(gobject_class, HSCROLL_POLICY, "hscroll-policy");
+  g_object_class_override_property(gobject_class, VSCROLL_POLICY, "vscroll-policy");
+
+  //Emitted with the start and the end in microseconds of what the clips
+  //changed, once per begin/end_update pair
+  timeline_signals[CHANGED] = g_signal_new("changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2, G_TYPE_INT64, G_TYPE_INT64);
+
+  //Emitted at most once per frame while the time marker is dragged, with
+  //its time in microseconds
+  timeline_signals[SCRUB] = g_signal_new("scrub", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_INT64);
 }
 //Needed for g_object_set().
 static void gtk_timeline_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
 {
   ImgTimeline *da = GTK_TIMELINE(object);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
   switch(prop_id)
   {
@@ -103,8 +503,52 @@ static void gtk_timeline_set_property(GObject *object, guint prop_id, const GVal
       case TOTAL_TIME:
         gtk_timeline_set_total_time(da, g_value_get_int(value));
       break; 
+      case DURATION:
+        gtk_timeline_set_duration(da, g_value_get_int64(value));
+      break;
       case TIME_MARKER_POS:
-        gtk_timeline_set_time_marker(da, g_value_get_int(value));
+        gtk_timeline_set_time_marker_x(da, g_value_get_int(value));
+      break;
+      case TIME_MARKER:
+        gtk_timeline_set_time_marker_time(da, g_value_get_int64(value));
+      break;
+      case FRAME_RATE_NUM:
+        gtk_timeline_set_frame_rate(da, g_value_get_int(value), priv->frame_rate_den);
+      break;
+      case FRAME_RATE_DEN:
+        gtk_timeline_set_frame_rate(da, priv->frame_rate_num, g_value_get_int(value));
+      break;
+      case DECODE_THREADS:
+        gtk_timeline_set_decode_threads(da, g_value_get_int(value));
+      break;
+      case DEBUG_DAMAGE:
+        gtk_timeline_set_debug_damage(da, g_value_get_boolean(value));
+      break;
+      case PIXELS_PER_SECOND:
+        gtk_timeline_set_pixels_per_second(da, g_value_get_double(value));
+      break;
+      case CACHE_BUDGET:
+        gtk_timeline_set_cache_budget(da, g_value_get_uint64(value));
+      break;
+      case STATS:
+        gtk_timeline_set_stats(da, g_value_get_boolean(value));
+      break;
+      case STATS_OVERLAY:
+        gtk_timeline_set_stats_overlay(da, g_value_get_boolean(value));
+      break;
+      case HADJUSTMENT:
+        gtk_timeline_set_hadjustment(da, g_value_get_object(value));
+      break;
+      case VADJUSTMENT:
+        gtk_timeline_set_vadjustment(da, g_value_get_object(value));
+      break;
+      case HSCROLL_POLICY:
+        priv->hscroll_policy = g_value_get_enum(value);
+        gtk_widget_queue_resize(GTK_WIDGET(da));
+      break;
+      case VSCROLL_POLICY:
+        priv->vscroll_policy = g_value_get_enum(value);
+        gtk_widget_queue_resize(GTK_WIDGET(da));
       break;
 
     default:
@@ -128,6 +572,7 @@ void gtk_timeline_set_video_background(ImgTimeline *da, const gchar *background_
     g_free(priv->video_background_string);
   
   priv->video_background_string = g_strdup(background_string); 
+  gtk_timeline_invalidate_tiles(da);
 }
 
 void gtk_timeline_set_audio_background(ImgTimeline *da, const gchar *background_string)
@@ -145,430 +590,2623 @@ void gtk_timeline_set_audio_background(ImgTimeline *da, const gchar *background_
     g_free(priv->audio_background_string);
   
   priv->audio_background_string = g_strdup(background_string); 
+  gtk_timeline_invalidate_tiles(da);
 }
 
 void gtk_timeline_set_total_time(ImgTimeline *da, gint total_time)
+{
+  gtk_timeline_set_duration(da, (gint64)MAX(0, total_time) * G_TIME_SPAN_SECOND);
+}
+
+void gtk_timeline_set_duration(ImgTimeline *da, gint64 duration)
 {
   ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->total_time = total_time;
+  priv->duration = MAX(0, duration);
+  gtk_timeline_configure_hadjustment(da);
+  gtk_timeline_invalidate_tiles(da);
 }
 
-void gtk_timeline_set_time_marker(ImgTimeline *da, gint posx)
+gint64 gtk_timeline_get_duration(ImgTimeline *da)
 {
   ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->time_marker_pos = posx;
+  return priv->duration;
 }
 
-static void gtk_timeline_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+void gtk_timeline_set_frame_rate(ImgTimeline *da, gint frame_rate_num, gint frame_rate_den)
 {
-  ImgTimeline *da = GTK_TIMELINE(object);
   ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
-  
-  switch(prop_id)
-  {
-    case VIDEO_BACKGROUND:
-      g_value_set_string(value, priv->video_background_string);
-      break;
-    case AUDIO_BACKGROUND:
-      g_value_set_string(value, priv->audio_background_string);
-      break;
-     case TOTAL_TIME:
-      g_value_set_int(value, priv->total_time);
-      break;
 
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-  }
+  g_return_if_fail(frame_rate_num > 0 && frame_rate_den > 0);
+
+  priv->frame_rate_num = frame_rate_num;
+  priv->frame_rate_den = frame_rate_den;
+  gtk_timeline_invalidate_tiles(da);
 }
 
-static void gtk_timeline_init(ImgTimeline *da)
+gint64 gtk_timeline_time_to_frame(ImgTimeline *da, gint64 time)
 {
   ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
-  GtkCssProvider *css;
 
-  css = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css, "button {border-radius:0px;}" , -1, NULL);
-  gtk_style_context_add_provider_for_screen (gdk_screen_get_default(), GTK_STYLE_PROVIDER(css),GTK_STYLE_PROVIDER_PRIORITY_USER);
-  g_object_unref (css);
-
-  priv->last_slide_posX = 0;
-  priv->zoom = 1;
-  priv->seconds = 0;
-  priv->minutes = 0;
-  priv->hours = 0;
-  priv->total_time = 0;
-  priv->time_marker_pos = 0;
+  return gtk_timeline_frame_at(time, priv->frame_rate_num, priv->frame_rate_den);
+}
 
-  priv->video_background[0]=0.0;
-  priv->video_background[1]=0.0;
-  priv->video_background[2]=0.0;
-  priv->video_background[3]=1.0;
-  
-  priv->audio_background[0]=0.0;
-  priv->audio_background[1]=0.0;
-  priv->audio_background[2]=0.0;
-  priv->audio_background[3]=1.0;
+gint64 gtk_timeline_frame_to_time(ImgTimeline *da, gint64 frame)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->video_background_string = g_strdup("rgba(0, 0, 0, 1.0)");
-  priv->audio_background_string = g_strdup("rgba(0, 0, 0, 1.0)");
+  return gtk_timeline_frame_start(frame, priv->frame_rate_num, priv->frame_rate_den);
 }
 
-GtkWidget* gtk_timeline_new()
+gchar *gtk_timeline_format_timecode(ImgTimeline *da, gint64 time)
 {
-  return GTK_WIDGET(g_object_new(gtk_timeline_get_type(), NULL));
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint64 frame, seconds;
+  gint rate;
+
+  rate = gtk_timeline_timecode_rate(priv->frame_rate_num, priv->frame_rate_den);
+  frame = gtk_timeline_frame_at(time, priv->frame_rate_num, priv->frame_rate_den);
+  seconds = frame / rate;
+  return g_strdup_printf("%02" G_GINT64_FORMAT ":%02d:%02d:%02d", seconds / 3600, (gint)(seconds / 60 % 60), (gint)(seconds % 60), (gint)(frame % rate));
 }
 
-static gboolean gtk_timeline_draw(GtkWidget *da, cairo_t *cr)
+void gtk_timeline_set_pixels_per_second(ImgTimeline *da, gdouble pixels_per_second)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  gint width = gtk_widget_get_allocated_width(da);
+  pixels_per_second = CLAMP(pixels_per_second, MIN_PIXELS_PER_SECOND, MAX_PIXELS_PER_SECOND);
+  if (pixels_per_second == priv->pixels_per_second)
+    return;
 
-  cairo_save(cr);
-  cairo_translate (cr, 0 , 12);
-  gtk_timeline_draw_time_ticks(da, cr, width);
+  priv->pixels_per_second = pixels_per_second;
 
-  //Video timeline
-  cairo_translate (cr, 0 , 20);
-  cairo_set_source_rgba(cr, priv->video_background[0], priv->video_background[1], priv->video_background[2], priv->video_background[3]);
-  cairo_set_line_width(cr, 1);
-  cairo_rectangle(cr, 0,10, width - 2, 64);
-  cairo_fill(cr);
-  
-  //Audio timeline
-  cairo_set_source_rgba(cr, priv->audio_background[0], priv->audio_background[1], priv->audio_background[2], priv->audio_background[3]);
-  cairo_rectangle(cr, 0,80, width - 2, 64);
-  cairo_fill(cr);
-  cairo_restore(cr);
+  //The left edge stays on its time
+  gtk_timeline_configure_hadjustment(da);
+  gtk_timeline_invalidate_tiles(da);
+}
 
-  //This is necessary to draw the slides represented by the GtkButtons
-  GTK_WIDGET_CLASS (gtk_timeline_parent_class)->draw (da, cr);
+//Zooms by factor keeping the time under x, in widget coordinates, where it is
+void gtk_timeline_zoom_at(ImgTimeline *da, gdouble factor, gdouble x)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint64 time;
 
-  //Draw the red time marker 
-  gtk_timeline_draw_time_marker(da, cr, priv->time_marker_pos);
-  return TRUE;
+  time = priv->scroll_time + x * G_TIME_SPAN_SECOND / priv->pixels_per_second;
+  gtk_timeline_set_pixels_per_second(da, priv->pixels_per_second * factor);
+  gtk_timeline_scroll_to_time(da, time - (gint64)(x * G_TIME_SPAN_SECOND / priv->pixels_per_second));
 }
 
-static void gtk_timeline_finalize(GObject *object)
-{ 
-  ImgTimeline *da = GTK_TIMELINE(object);
-  ImgTimelinePrivate *priv =gtk_timeline_get_instance_private(da);
-  
-  g_free(priv->video_background_string);
-  g_free(priv->audio_background_string);
-  
-  if(priv->surface != NULL)
-    cairo_surface_destroy(priv->surface);
+//The zoom used to be a level shared by every timeline, direction is the
+//sign of the wheel delta as it was
+void gtk_timeline_adjust_zoom(GtkWidget *da, gint zoom, gint direction)
+{
+  if (direction != 0)
+    gtk_timeline_zoom_at((ImgTimeline*)da, direction > 0 ? 1 / ZOOM_STEP : ZOOM_STEP, 0);
+}
 
-  G_OBJECT_CLASS(gtk_timeline_parent_class)->finalize(object);
+void gtk_timeline_scroll_to_time(ImgTimeline *da, gint64 time)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  priv->scroll_time = MAX(0, time);
+  gtk_timeline_configure_hadjustment(da);
+  gtk_widget_queue_draw(GTK_WIDGET(da));
 }
 
-void gtk_timeline_draw_time_ticks(GtkWidget *da, cairo_t *cr, gint width)
+gint64 gtk_timeline_get_scroll_time(ImgTimeline *da)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
-  cairo_text_extents_t extents;
-  gchar *time;
-  gint i, factor;
-  gdouble distanceBetweenTicks, cairo_factor;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  distanceBetweenTicks = 48.5 - priv->zoom;
-  factor = 2;
+  return priv->scroll_time;
+}
 
-  if (distanceBetweenTicks <= 12)
-    distanceBetweenTicks = 12;    
-  
-  gtk_widget_set_size_request(da, (priv->total_time * distanceBetweenTicks), -1);
-  cairo_set_source_rgb(cr, 0,0,0);
+//Only the page is allocated, the adjustment spans the whole timeline
+static void gtk_timeline_size_allocate(GtkWidget *da, GtkAllocation *allocation)
+{
+  GTK_WIDGET_CLASS(gtk_timeline_parent_class)->size_allocate(da, allocation);
+  gtk_timeline_configure_hadjustment((ImgTimeline*)da);
+}
 
-  for (i = 0; i < priv->total_time; i++)
-  {
-    if (i % 2 == 0)
-      cairo_factor = 0;
-    else
-      cairo_factor = 0.5;
-    
-    //Draw the line markers
-    cairo_move_to( cr, i * distanceBetweenTicks + cairo_factor, 4);
-    cairo_line_to( cr, i * distanceBetweenTicks + cairo_factor, 24);
-    //Draw the sub line markers
-    // if (distanceBetweenTicks > 12)
-    // {
-    //   for (j = 9; j < distanceBetweenTicks; j +=10)
-    //   {
-    //     cairo_move_to( cr, (i * distanceBetweenTicks + cairo_factor) + j , 12);
-    //     cairo_line_to( cr, (i * distanceBetweenTicks + cairo_factor) + j , 24);
-    //   }
-    // }
-
-    if (priv->zoom >= 8)
-        factor = 4;
-    else
-        factor = 1;
+static void gtk_timeline_set_hadjustment(ImgTimeline *da, GtkAdjustment *adjustment)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-    if (i % factor == 0)
-    {  
-      time = g_strdup_printf("%02d:%02d:%02d", priv->hours, priv->minutes, priv->seconds);
-      cairo_select_font_face(cr, "Ubuntu", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-      cairo_set_font_size(cr, 10);
-      cairo_text_extents(cr, time, &extents);
-      cairo_move_to(cr, (-extents.width/2) + i*distanceBetweenTicks, 0);  
-      cairo_show_text(cr, time);
-      g_free(time);
-    }
-    
-    if (priv->seconds >= 59)
-    {
-        priv->seconds = -1;
-        priv->minutes++;
-    }   
-    if (priv->minutes >= 59)
-    {
-        priv->minutes = 0;
-        priv->hours++;
-    }
-    priv->seconds += priv->zoom;
-    if (priv->seconds > 59)
-      priv->seconds = 59;
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new(0, 0, 0, 0, 0, 0);
+  if (priv->hadjustment == adjustment)
+    return;
 
-    cairo_stroke(cr);
+  if (priv->hadjustment)
+  {
+    g_signal_handlers_disconnect_by_func(priv->hadjustment, gtk_timeline_hadjustment_changed, da);
+    g_object_unref(priv->hadjustment);
   }
-  priv->seconds = priv->minutes = priv->hours = 0;
+  priv->hadjustment = g_object_ref_sink(adjustment);
+  g_signal_connect(adjustment, "value-changed", G_CALLBACK(gtk_timeline_hadjustment_changed), da);
+  gtk_timeline_configure_hadjustment(da);
 }
 
-void gtk_timeline_adjust_zoom(GtkWidget *da, gint zoom, gint direction)
+//The timeline doesn't scroll vertically, the adjustment is only kept
+static void gtk_timeline_set_vadjustment(ImgTimeline *da, GtkAdjustment *adjustment)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->zoom = zoom;
-  if (direction > 0)
-    priv->total_time--;
-  else
-    priv->total_time++;
-  //TODO change 300 to the total time of the slideshow
-  if (priv->total_time < 300)
-      priv->total_time = 300;
-g_print("adjust zoom: %d\n",priv->total_time);
-  gtk_widget_queue_draw(GTK_WIDGET(da));
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new(0, 0, 0, 0, 0, 0);
+  if (priv->vadjustment == adjustment)
+    return;
+
+  if (priv->vadjustment)
+    g_object_unref(priv->vadjustment);
+  priv->vadjustment = g_object_ref_sink(adjustment);
 }
 
-void gtk_timeline_add_slide(GtkWidget *da, gchar *filename, gint x)
+static void gtk_timeline_configure_hadjustment(ImgTimeline *da)
 {
-  GdkPixbuf *pix;
-  GtkWidget *img;
-  GtkWidget *button;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gdouble value, upper, page_size;
 
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  if (priv->hadjustment == NULL)
+    return;
 
-  button = gtk_toggle_button_new();
-  gtk_widget_add_events( button,  GDK_POINTER_MOTION_MASK
-                                | GDK_LEAVE_NOTIFY_MASK
-                                | GDK_BUTTON1_MASK 
-                                | GDK_BUTTON1_MOTION_MASK
-                                | GDK_BUTTON_PRESS_MASK
-                                | GDK_BUTTON_RELEASE_MASK);
-
-  pix = gdk_pixbuf_new_from_file_at_scale(filename, -1,50, TRUE, NULL);
-  if (pix == NULL)
-    img = gtk_image_new_from_icon_name("image-missing", GTK_ICON_SIZE_DIALOG);
-  else
+  page_size = gtk_widget_get_allocated_width(GTK_WIDGET(da));
+  upper = MAX(ceil(gtk_timeline_time_to_x(priv, priv->duration)), page_size);
+  value = gtk_timeline_time_to_x(priv, priv->scroll_time);
+  if (value > upper - page_size)
   {
-    img = gtk_image_new_from_pixbuf(pix);
-    g_signal_connect(G_OBJECT(button), "drag-data-get",      G_CALLBACK(gtk_timeline_drag_data_get), NULL);
-    g_signal_connect(G_OBJECT(button), "motion-notify-event",G_CALLBACK(gtk_timeline_slide_motion_notify), da);
-    g_signal_connect(G_OBJECT(button), "leave-notify-event", G_CALLBACK(gtk_timeline_slide_leave_event), da);
-    g_signal_connect(G_OBJECT(button), "button-press-event", G_CALLBACK(gtk_timeline_slide_button_press_event), da);
-    g_signal_connect(G_OBJECT(button), "button-release-event", G_CALLBACK(gtk_timeline_slide_button_release_event), da);
+    value = upper - page_size;
+    priv->scroll_time = gtk_timeline_x_to_time(priv, value);
   }
-  gtk_button_set_image (GTK_BUTTON (button), img);
-  if (pix)
-    g_object_unref(pix);
-
-  gtk_container_add(GTK_CONTAINER(da), button);
-  gtk_widget_show(button);
-  if (x > 0)
-    gtk_layout_move(GTK_LAYOUT(da), button, x - 47.5, 43);
-  else
-    gtk_layout_move(GTK_LAYOUT(da), button, priv->last_slide_posX, 43);
-  priv->last_slide_posX += 95;
-  gtk_widget_set_size_request(button, 95, (pix ? -1 : 52));
+  gtk_adjustment_configure(priv->hadjustment, value, 0, upper, page_size * 0.1, page_size * 0.9, page_size);
 }
 
-void gtk_timeline_draw_time_marker(GtkWidget *widget, cairo_t *cr, gint posx)
+static void gtk_timeline_hadjustment_changed(GtkAdjustment *adjustment, ImgTimeline *da)
 {
-  cairo_save(cr);
-  cairo_set_source_rgb(cr, 1,0,0);
-  cairo_translate(cr, posx,17);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gdouble value = gtk_adjustment_get_value(adjustment);
 
-  gint i;
-  gint points[3][2] = { 
-                        { 0, 0 }, 
-                        { 5, 15 }, 
-                        { 10, 0 } 
-               
-                      };
+  //Set back from scroll_time itself, which stays exact
+  if (fabs(value - gtk_timeline_time_to_x(priv, priv->scroll_time)) < 0.5)
+    return;
 
-  for (i = 0; i < 3; i++)
-    cairo_line_to(cr, points[i][0], points[i][1]);
+  priv->scroll_time = gtk_timeline_x_to_time(priv, value);
+  gtk_widget_queue_draw(GTK_WIDGET(da));
+}
 
-  cairo_close_path(cr);
-  cairo_stroke_preserve(cr);
-  cairo_fill(cr);
+//Timeline pixels at the left edge of the widget, whole so that the edges
+//of the clips stay sharp
+static gdouble gtk_timeline_get_offset(ImgTimelinePrivate *priv)
+{
+  return round(gtk_timeline_time_to_x(priv, priv->scroll_time));
+}
 
-  cairo_move_to(cr, 5,15);
-  cairo_line_to(cr, 5,159);
-  cairo_stroke(cr);
-  cairo_restore(cr);
+//How far the tracks go, in timeline pixels
+static gint gtk_timeline_get_width(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  return MAX(ceil(gtk_timeline_time_to_x(priv, priv->duration)), gtk_timeline_get_offset(priv) + gtk_widget_get_allocated_width(da));
 }
 
-void gtk_timeline_drag_data_get(GtkWidget *widget, GdkDragContext *drag_context, GtkSelectionData *data, guint info, guint time,
-gpointer user_data)
+void gtk_timeline_set_time_marker(ImgTimeline *da, gint posx)
 {
-  gtk_selection_data_set (data, gdk_atom_intern_static_string ("GTK_TIMELINE_SLIDE"), 32, (const guchar *)&widget, sizeof (gpointer));
+  gtk_timeline_set_time_marker_x(da, posx);
 }
 
-void img_timeline_adjust_marker_posx(GtkWidget *da, gint posx)
+//The marker's left edge at posx, what the pixel API and property did
+static void gtk_timeline_set_time_marker_x(ImgTimeline *da, gint posx)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->time_marker_pos = posx;
-  gtk_widget_queue_draw((GtkWidget*)da);
+  gtk_timeline_set_time_marker_time(da, gtk_timeline_x_to_time(priv, posx + MARKER_WIDTH / 2));
 }
 
-gboolean gtk_timeline_mouse_button_press (GtkWidget *timeline, GdkEvent *event, gpointer user_data)
+void gtk_timeline_set_time_marker_time(ImgTimeline *da, gint64 time)
 {
-  if (event->button.y < 16.0 || event->button.y > 32.0)
-    return FALSE;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  img_timeline_adjust_marker_posx(timeline, event->button.x - 5);
-  return TRUE;
+  gtk_timeline_queue_draw_marker(GTK_WIDGET(da), gtk_timeline_get_marker_x(priv));
+  priv->time_marker = MAX(0, time);
+  gtk_timeline_queue_draw_marker(GTK_WIDGET(da), gtk_timeline_get_marker_x(priv));
 }
 
-// gboolean gtk_timeline_motion_notify(GtkWidget *timeline, GdkEventMotion *event, gpointer data)
-// {
-//   if ( (event->state & GDK_BUTTON1_MOTION_MASK) && (event->y > 17.0 && event->y < 32.0) )
-//     img_timeline_adjust_marker_posx(timeline, event->x - 5);
+gint64 gtk_timeline_get_time_marker_time(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  return priv->time_marker;
+}
 
-//   return FALSE;
-// }
+//Where gtk_timeline_draw_time_marker() draws the marker from, its line is
+//on the pixel of the time like the ticks of the ruler
+static gint gtk_timeline_get_marker_x(ImgTimelinePrivate *priv)
+{
+  return floor(gtk_timeline_time_to_x(priv, priv->time_marker)) - MARKER_WIDTH / 2;
+}
 
-gboolean gtk_timeline_slide_button_press_event(GtkWidget *button, GdkEventButton *event, ImgTimeline *timeline)
+void gtk_timeline_set_decode_threads(ImgTimeline *da, gint decode_threads)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(timeline);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->button_pressed = TRUE;
-  offsetX = event->x - oldx1; 
+  //The range of the property, the pool would take anything
+  g_return_if_fail(decode_threads >= 1 && decode_threads <= 64);
 
-  return FALSE;
+  priv->decode_threads = decode_threads;
+  g_thread_pool_set_max_threads(priv->decode_pool, decode_threads, NULL);
 }
 
-gboolean gtk_timeline_slide_button_release_event(GtkWidget *button, GdkEventButton *event, ImgTimeline *timeline)
+void gtk_timeline_set_cache_budget(ImgTimeline *da, guint64 cache_budget)
 {
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(timeline);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  priv->button_pressed = FALSE;
+  priv->cache_budget = cache_budget;
+  gtk_timeline_cache_trim(da);
+}
 
-  oldx1 = X1;
+void gtk_timeline_get_cache_stats(ImgTimeline *da, ImgTimelineCacheStats *stats)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  return FALSE;
+  stats->hits = priv->cache_hits;
+  stats->misses = priv->cache_misses;
+  stats->evictions = priv->cache_evictions;
+  stats->bytes = priv->cache_bytes;
+  stats->budget = priv->cache_budget;
+  stats->resident = priv->lru.length;
 }
 
-static gboolean gtk_timeline_slide_motion_notify(GtkWidget *button, GdkEventMotion *event, ImgTimeline *timeline)
+void gtk_timeline_set_stats(ImgTimeline *da, gboolean stats)
 {
-  g_print("motion_notify\n");
-  gint x;
-  GdkCursor *cursor;
-  GdkWindow *window;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  stats = stats != FALSE;
+  if (priv->stats_enabled == stats)
+    return;
+
+  priv->stats_enabled = stats;
+  if ( ! stats)
+    gtk_timeline_set_stats_overlay(da, FALSE);
+  g_object_notify(G_OBJECT(da), "stats");
+}
 
-  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(timeline);
-  window = gtk_widget_get_window(button);
-  x = gtk_widget_get_allocated_width(button);
+//The overlay shows the stats so it collects them too
+void gtk_timeline_set_stats_overlay(ImgTimeline *da, gboolean stats_overlay)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  if (priv->button_pressed)
+  stats_overlay = stats_overlay != FALSE;
+  if (priv->stats_overlay == stats_overlay)
+    return;
+
+  priv->stats_overlay = stats_overlay;
+  if (stats_overlay)
   {
-     X1 = event->x - offsetX;
-     gtk_layout_move(GTK_LAYOUT(timeline), button, X1, 43);
+    gtk_timeline_set_stats(da, TRUE);
+    priv->stats_timeout = g_timeout_add(STATS_REFRESH, gtk_timeline_stats_timeout, da);
   }
-  if ( (event->x - 90) * (event->x - x) <= 0) //is the button x coord in the range?
+  else
   {
-    cursor = gdk_cursor_new_for_display(gdk_display_get_default(), GDK_RIGHT_SIDE);  
-    //gtk_widget_set_size_request(button,event->x, -1);
+    g_source_remove(priv->stats_timeout);
+    priv->stats_timeout = 0;
   }
-  else
-    cursor = gdk_cursor_new_for_display(gdk_display_get_default(), GDK_ARROW);
+  gtk_timeline_queue_draw_visible(GTK_WIDGET(da));
+  g_object_notify(G_OBJECT(da), "stats_overlay");
+}
 
-  gdk_window_set_cursor(window, cursor);
+void gtk_timeline_get_stats(ImgTimeline *da, ImgTimelineStats *stats)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  return FALSE;
+  *stats = priv->stats;
+  gtk_timeline_get_cache_stats(da, &stats->cache);
 }
 
-static gboolean gtk_timeline_slide_leave_event(GtkWidget *button, GdkEventCrossing *event, gpointer timeline)
+void gtk_timeline_reset_stats(ImgTimeline *da)
 {
-  GdkCursor *cursor;
-  GdkWindow *window;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
 
-  window = gtk_widget_get_window(button);
-  cursor = gdk_cursor_new_for_display(gdk_display_get_default(), GDK_ARROW);
-  gdk_window_set_cursor(window, cursor);
-  return FALSE;
+  memset(&priv->stats, 0, sizeof(ImgTimelineStats));
 }
 
-gboolean gtk_timeline_scroll(GtkWidget *timeline, GdkEventScroll *event, GtkWidget *scrolledwindow)
+guint64 gtk_timeline_histogram_percentile(const ImgTimelineHistogram *histogram, gdouble p)
 {
-  GdkModifierType accel_mask = gtk_accelerator_get_default_mod_mask();
-  GtkAdjustment *scrollX     = gtk_scrollable_get_hadjustment(GTK_SCROLLABLE(scrolledwindow));
-  gdouble deltax, deltay;
-  GdkScrollDirection direction;
+  guint64 seen = 0, rank;
+  gint i;
 
-  static gint zoom = 1;
-  
-  if (gdk_event_get_scroll_direction((GdkEvent*)event, &direction))
-  {
-    if ( direction == GDK_SCROLL_DOWN )
-      gtk_adjustment_set_value(scrollX, gtk_adjustment_get_value(scrollX) + 40);
+  if (histogram->count == 0)
+    return 0;
 
-    if ( direction == GDK_SCROLL_UP )
-      gtk_adjustment_set_value(scrollX, gtk_adjustment_get_value(scrollX) - 40);    
-  }
-  else
+  rank = MAX(1, ceil(p * histogram->count));
+  for (i = 0; i < GTK_TIMELINE_HISTOGRAM_BUCKETS; i++)
   {
-    gdk_event_get_scroll_deltas((GdkEvent *)event, &deltax, &deltay);
-    if (deltay > 0)
-      gtk_adjustment_set_value(scrollX, gtk_adjustment_get_value(scrollX) + 40);
-  else
-      gtk_adjustment_set_value(scrollX, gtk_adjustment_get_value(scrollX) - 40);
+    seen += histogram->buckets[i];
+    if (seen >= rank)
+      return i == 0 ? 0 : MIN(((guint64)1 << i) - 1, histogram->max);
   }
-  if ( (event->state & accel_mask) == GDK_CONTROL_MASK)
-  {
-    if (deltay > 0)
-      zoom --;
-    else if (deltay < 0)
-      zoom ++;
+  return histogram->max;
+}
 
-    if (zoom < 1)
-        zoom = 1;
-    gtk_timeline_adjust_zoom(timeline, zoom, deltay);
+void gtk_timeline_set_debug_damage(ImgTimeline *da, gboolean debug_damage)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  priv->debug_damage = debug_damage;
+}
+
+static void gtk_timeline_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  ImgTimeline *da = GTK_TIMELINE(object);
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  
+  switch(prop_id)
+  {
+    case VIDEO_BACKGROUND:
+      g_value_set_string(value, priv->video_background_string);
+      break;
+    case AUDIO_BACKGROUND:
+      g_value_set_string(value, priv->audio_background_string);
+      break;
+     case TOTAL_TIME:
+      g_value_set_int(value, priv->duration / G_TIME_SPAN_SECOND);
+      break;
+     case DURATION:
+      g_value_set_int64(value, priv->duration);
+      break;
+     case TIME_MARKER_POS:
+      g_value_set_int(value, gtk_timeline_get_marker_x(priv));
+      break;
+     case TIME_MARKER:
+      g_value_set_int64(value, priv->time_marker);
+      break;
+     case FRAME_RATE_NUM:
+      g_value_set_int(value, priv->frame_rate_num);
+      break;
+     case FRAME_RATE_DEN:
+      g_value_set_int(value, priv->frame_rate_den);
+      break;
+     case DECODE_THREADS:
+      g_value_set_int(value, priv->decode_threads);
+      break;
+     case DEBUG_DAMAGE:
+      g_value_set_boolean(value, priv->debug_damage);
+      break;
+     case PIXELS_PER_SECOND:
+      g_value_set_double(value, priv->pixels_per_second);
+      break;
+     case CACHE_BUDGET:
+      g_value_set_uint64(value, priv->cache_budget);
+      break;
+     case STATS:
+      g_value_set_boolean(value, priv->stats_enabled);
+      break;
+     case STATS_OVERLAY:
+      g_value_set_boolean(value, priv->stats_overlay);
+      break;
+     case HADJUSTMENT:
+      g_value_set_object(value, priv->hadjustment);
+      break;
+     case VADJUSTMENT:
+      g_value_set_object(value, priv->vadjustment);
+      break;
+     case HSCROLL_POLICY:
+      g_value_set_enum(value, priv->hscroll_policy);
+      break;
+     case VSCROLL_POLICY:
+      g_value_set_enum(value, priv->vscroll_policy);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+  }
+}
+
+static void gtk_timeline_init(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint i;
+
+  gtk_widget_add_events(GTK_WIDGET(da), GDK_POINTER_MOTION_MASK
+                                      | GDK_LEAVE_NOTIFY_MASK
+                                      | GDK_BUTTON_PRESS_MASK
+                                      | GDK_BUTTON_RELEASE_MASK);
+
+  gtk_timeline_clip_store_init(&priv->clips);
+  gtk_timeline_clip_store_init(&priv->audio_clips);
+  g_queue_init(&priv->lru);
+  priv->cache_budget = DEFAULT_CACHE_BUDGET;
+  priv->cache_bytes = 0;
+  priv->cache_hits = 0;
+  priv->cache_misses = 0;
+  priv->cache_evictions = 0;
+  priv->visible_serial = 0;
+  priv->update_depth = 0;
+  priv->drag_clip = -1;
+  priv->drag_pending = FALSE;
+  priv->drag_delta = 0;
+  priv->cursor = CURSOR_DEFAULT;
+  priv->exporting = FALSE;
+  priv->debug_damage = FALSE;
+  priv->flash = NULL;
+  priv->flash_clear = NULL;
+  priv->flash_timeout = 0;
+  priv->scrubbing = FALSE;
+  priv->scrub_pending = FALSE;
+  priv->tick = 0;
+  priv->stats_enabled = FALSE;
+  priv->stats_overlay = FALSE;
+  priv->stats_timeout = 0;
+  memset(&priv->stats, 0, sizeof(ImgTimelineStats));
+  priv->pixels_per_second = DEFAULT_PIXELS_PER_SECOND;
+  priv->labels.font = NULL;
+  priv->labels.ready = FALSE;
+  for (i = 0; i < TILE_SLOTS; i++)
+  {
+    priv->tiles[i].surface = NULL;
+    priv->tiles[i].index = -1;
+    priv->tiles[i].queued = -1;
+  }
+  priv->tiles_width = 0;
+  priv->tiles_serial = 0;
+  priv->duration = 0;
+  priv->time_marker = 0;
+  priv->frame_rate_num = DEFAULT_FRAME_RATE_NUM;
+  priv->frame_rate_den = DEFAULT_FRAME_RATE_DEN;
+  priv->scroll_time = 0;
+  priv->hadjustment = NULL;
+  priv->vadjustment = NULL;
+  priv->hscroll_policy = GTK_SCROLL_MINIMUM;
+  priv->vscroll_policy = GTK_SCROLL_MINIMUM;
+  gtk_timeline_set_hadjustment(da, NULL);
+  gtk_timeline_set_vadjustment(da, NULL);
+
+  priv->video_background[0]=0.0;
+  priv->video_background[1]=0.0;
+  priv->video_background[2]=0.0;
+  priv->video_background[3]=1.0;
+  
+  priv->audio_background[0]=0.0;
+  priv->audio_background[1]=0.0;
+  priv->audio_background[2]=0.0;
+  priv->audio_background[3]=1.0;
+
+  priv->video_background_string = g_strdup("rgba(0, 0, 0, 1.0)");
+  priv->audio_background_string = g_strdup("rgba(0, 0, 0, 1.0)");
+
+  //The thumbnails are decoded off the main thread and handed back in batches
+  priv->decode_threads = 4;
+  priv->decode_pool = g_thread_pool_new(gtk_timeline_decode_thread, da, priv->decode_threads, FALSE, NULL);
+  priv->decode_cancellable = g_cancellable_new();
+  g_mutex_init(&priv->decode_lock);
+  priv->decoded = g_ptr_array_new();
+  priv->decode_idle = 0;
+
+  //So are the tiles, as many at once as there are cores
+  priv->tile_pool = g_thread_pool_new(gtk_timeline_tile_thread, da, CLAMP(g_get_num_processors(), 1, TILE_MAX_THREADS), FALSE, NULL);
+  g_mutex_init(&priv->tile_lock);
+  priv->tiled = g_ptr_array_new();
+  priv->tile_idle = 0;
+}
+
+GtkWidget* gtk_timeline_new()
+{
+  return GTK_WIDGET(g_object_new(gtk_timeline_get_type(), NULL));
+}
+
+static gboolean gtk_timeline_draw(GtkWidget *da, cairo_t *cr)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  gint width = gtk_timeline_get_width(da);
+  gint64 frame, time;
+
+  frame = time = gtk_timeline_stats_phase(priv, GTK_TIMELINE_N_PHASES, 0);
+  cairo_save(cr);
+  cairo_translate(cr, -gtk_timeline_get_offset(priv), 0);
+  gtk_timeline_draw_tiles(da, cr, width);
+  time = gtk_timeline_stats_phase(priv, GTK_TIMELINE_PHASE_TILES, time);
+
+  gtk_timeline_draw_slides(da, cr);
+  time = gtk_timeline_stats_phase(priv, GTK_TIMELINE_PHASE_SLIDES, time);
+  gtk_timeline_draw_audio(da, cr);
+  time = gtk_timeline_stats_phase(priv, GTK_TIMELINE_PHASE_AUDIO, time);
+
+  //Draw the red time marker 
+  gtk_timeline_draw_time_marker(da, cr, gtk_timeline_get_marker_x(priv));
+  gtk_timeline_stats_phase(priv, GTK_TIMELINE_PHASE_MARKER, time);
+  gtk_timeline_stats_phase(priv, GTK_TIMELINE_PHASE_FRAME, frame);
+  cairo_restore(cr);
+
+  //The overlays are on the widget, not on the timeline
+  if (priv->stats_overlay)
+    gtk_timeline_draw_stats(da, cr);
+  if (priv->debug_damage)
+    gtk_timeline_flash_damage(da, cr);
+  return TRUE;
+}
+
+gboolean gtk_timeline_render_strips(ImgTimeline *da, gint64 start, gint64 end, gdouble pixels_per_second, gint strip_width,
+                                    ImgTimelineStripFunc func, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineBackground background;
+  cairo_surface_t *surface;
+  gdouble widget_pixels_per_second;
+  gboolean ok = TRUE;
+  gint x, x1, x2, width;
+
+  g_return_val_if_fail(GTK_IS_TIMELINE(da), FALSE);
+  g_return_val_if_fail(pixels_per_second > 0 && strip_width > 0 && func != NULL, FALSE);
+
+  //The zoom is swapped for the export's and back, nothing else runs on the
+  //main loop meanwhile and the tile workers only see their own copies
+  widget_pixels_per_second = priv->pixels_per_second;
+  priv->pixels_per_second = pixels_per_second;
+  priv->exporting = TRUE;
+
+  x1 = floor(gtk_timeline_time_to_x(priv, MAX(0, start)));
+  x2 = ceil(gtk_timeline_time_to_x(priv, end));
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, MIN(strip_width, MAX(1, x2 - x1)), TILE_HEIGHT);
+  if (priv->labels.font == NULL)
+  {
+    cairo_t *cr = cairo_create(surface);
+
+    gtk_timeline_cache_label_glyphs(&priv->labels, cr);
+    cairo_destroy(cr);
+  }
+  gtk_timeline_get_background(priv, ceil(gtk_timeline_time_to_x(priv, priv->duration)), &background);
+
+  for (x = x1; ok && x < x2; x += strip_width)
+  {
+    if (g_cancellable_set_error_if_cancelled(cancellable, error))
+    {
+      ok = FALSE;
+      break;
+    }
+
+    //Only the last strip may be narrower
+    width = MIN(strip_width, x2 - x);
+    if (width != cairo_image_surface_get_width(surface))
+    {
+      cairo_surface_destroy(surface);
+      surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, TILE_HEIGHT);
+    }
+    gtk_timeline_export_load(da, gtk_timeline_x_to_time(priv, x - 1), gtk_timeline_x_to_time(priv, x + width + 1), cancellable);
+    gtk_timeline_render_strip(GTK_WIDGET(da), surface, &background, x);
+    ok = func(surface, x - x1, user_data, error);
+    gtk_timeline_cache_trim(da);
+  }
+
+  //The only way out once the zoom is swapped, a failure breaks to here
+  cairo_surface_destroy(surface);
+  cairo_scaled_font_destroy(background.labels.font);
+  priv->exporting = FALSE;
+  priv->pixels_per_second = widget_pixels_per_second;
+
+  return ok;
+}
+
+//The same drawing as gtk_timeline_draw(), the background straight from
+//gtk_timeline_draw_background() instead of the tiles
+static void gtk_timeline_render_strip(GtkWidget *da, cairo_surface_t *surface, const ImgTimelineBackground *background, gint x)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  cairo_t *cr;
+
+  cr = cairo_create(surface);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  cairo_translate(cr, -x, 0);
+  cairo_rectangle(cr, x, 0, cairo_image_surface_get_width(surface), TILE_HEIGHT);
+  cairo_clip(cr);
+
+  gtk_timeline_draw_background(background, cr);
+  gtk_timeline_draw_slides(da, cr);
+  gtk_timeline_draw_audio(da, cr);
+  gtk_timeline_draw_time_marker(da, cr, gtk_timeline_get_marker_x(priv));
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+}
+
+//An export can't wait for the workers, what it's about to draw is read here
+static void gtk_timeline_export_load(ImgTimeline *da, gint64 start, gint64 end, GCancellable *cancellable)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineThumb *thumb;
+  ImgTimelineAudio *audio;
+  GdkPixbuf *pix[MIP_LEVELS];
+  guint i, first, last;
+  gint l;
+
+  gtk_timeline_clip_store_query(&priv->clips, start, end, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->clips, i + 1, start, last))
+  {
+    thumb = priv->clips.thumb[i];
+    if (thumb->mip[0] || (thumb->flags & THUMB_MISSING))
+      continue;
+
+    priv->cache_misses++;
+    memset(pix, 0, sizeof(pix));
+    pix[0] = gtk_timeline_thumbnail_load(thumb->filename, SLIDE_HEIGHT - 2 * SLIDE_PADDING, cancellable);
+    //Not missing, only cut short
+    if (g_cancellable_is_cancelled(cancellable))
+    {
+      if (pix[0])
+        g_object_unref(pix[0]);
+      return;
+    }
+    gtk_timeline_thumb_scale(pix);
+    gtk_timeline_thumb_set(da, thumb, pix);
+    for (l = 0; l < MIP_LEVELS && pix[l]; l++)
+      g_object_unref(pix[l]);
+  }
+
+  gtk_timeline_clip_store_query(&priv->audio_clips, start, end, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->audio_clips, i + 1, start, last))
+  {
+    audio = priv->audio_clips.thumb[i];
+    if (audio->peaks || (audio->flags & THUMB_MISSING))
+      continue;
+
+    //The peak file first, like the workers, the WAV is only reduced without one
+    audio->peaks = gtk_timeline_peaks_load(audio->filename);
+    if (audio->peaks == NULL)
+    {
+      audio->peaks = gtk_timeline_peaks_from_wav(audio->filename, cancellable);
+      if (g_cancellable_is_cancelled(cancellable))
+      {
+        gtk_timeline_peaks_free(audio->peaks);
+        audio->peaks = NULL;
+        return;
+      }
+      if (audio->peaks)
+        gtk_timeline_peaks_save(audio->peaks, audio->filename);
+    }
+    audio->flags &= ~THUMB_LOADING;
+    if (audio->peaks == NULL)
+      audio->flags |= THUMB_MISSING;
+  }
+}
+
+//Runs on the tile workers, only background is looked at
+static void gtk_timeline_draw_background(const ImgTimelineBackground *background, cairo_t *cr)
+{
+  cairo_save(cr);
+  cairo_translate (cr, 0 , 12);
+  gtk_timeline_draw_time_ticks(background, cr);
+  cairo_restore(cr);
+
+  gtk_timeline_draw_tracks(background, cr);
+}
+
+static void gtk_timeline_draw_tracks(const ImgTimelineBackground *background, cairo_t *cr)
+{
+  gint x = 0, width = background->width - 2;
+
+  gtk_timeline_clip_span(cr, &x, &width);
+
+  cairo_save(cr);
+  //Video timeline
+  cairo_translate (cr, 0 , 32);
+  cairo_set_source_rgba(cr, background->video_background[0], background->video_background[1], background->video_background[2], background->video_background[3]);
+  cairo_set_line_width(cr, 1);
+  cairo_rectangle(cr, x,10, width, 64);
+  cairo_fill(cr);
+  
+  //Audio timeline
+  cairo_set_source_rgba(cr, background->audio_background[0], background->audio_background[1], background->audio_background[2], background->audio_background[3]);
+  cairo_rectangle(cr, x,80, width, 64);
+  cairo_fill(cr);
+  cairo_restore(cr);
+}
+
+//Cairo's fixed point only reaches about 8 million pixels from the device
+//origin, hours in at frame zoom the tracks and the long clips start or end
+//past that. Cut them to the clip area, a couple of pixels more so that the
+//cut edges and their strokes fall outside
+static void gtk_timeline_clip_span(cairo_t *cr, gint *x, gint *width)
+{
+  gdouble x1, y1, x2, y2;
+  gint64 from, to;
+
+  cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+  from = MAX(*x, (gint64)floor(x1) - 2);
+  to = MIN((gint64)*x + *width, (gint64)ceil(x2) + 2);
+  *x = from;
+  *width = MAX(0, to - from);
+}
+
+//The snapshot holds a reference on the label font, see gtk_timeline_tile_job_free()
+static void gtk_timeline_get_background(ImgTimelinePrivate *priv, gint width, ImgTimelineBackground *background)
+{
+  background->pixels_per_second = priv->pixels_per_second;
+  background->duration = priv->duration;
+  background->frame_rate_num = priv->frame_rate_num;
+  background->frame_rate_den = priv->frame_rate_den;
+  background->width = width;
+  memcpy(background->video_background, priv->video_background, sizeof(background->video_background));
+  memcpy(background->audio_background, priv->audio_background, sizeof(background->audio_background));
+  background->labels = priv->labels;
+  background->labels.font = cairo_scaled_font_reference(priv->labels.font);
+}
+
+//Only composites, the tiles that aren't ready are queued for the workers
+//and stood in for meanwhile so that a zoom never waits for them
+static void gtk_timeline_draw_tiles(GtkWidget *da, cairo_t *cr, gint width)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineBackground background;
+  ImgTimelineTile *slot;
+  gint tile, first, last;
+  gdouble x1, x2;
+
+  //The track backgrounds stop at the allocated width
+  if (priv->tiles_width != width)
+  {
+    g_atomic_int_inc(&priv->tiles_serial);
+    priv->tiles_width = width;
+  }
+  if (priv->labels.font == NULL)
+    gtk_timeline_cache_label_glyphs(&priv->labels, cr);
+
+  gtk_timeline_get_visible_range(da, cr, &x1, &x2);
+  first = MAX(0, floor(x1 / TILE_WIDTH));
+  last  = MIN((width - 1) / TILE_WIDTH, ceil(x2 / TILE_WIDTH) - 1);
+
+  gtk_timeline_get_background(priv, width, &background);
+  for (tile = first; tile <= last; tile++)
+  {
+    slot = &priv->tiles[tile % TILE_SLOTS];
+    if (slot->surface && slot->index == tile && slot->serial == priv->tiles_serial)
+    {
+      cairo_set_source_surface(cr, slot->surface, tile * TILE_WIDTH, 0);
+      cairo_rectangle(cr, tile * TILE_WIDTH, 0, TILE_WIDTH, TILE_HEIGHT);
+      cairo_fill(cr);
+      continue;
+    }
+    if (slot->queued != tile || slot->queued_serial != priv->tiles_serial)
+      gtk_timeline_queue_tile(da, &background, tile);
+    gtk_timeline_draw_stand_in(da, cr, &background, tile);
+  }
+  cairo_scaled_font_destroy(background.labels.font);
+}
+
+//The tiles of the last zoom still in the cache are stretched over the new
+//one, under them the bare tracks show where nothing was drawn yet
+static void gtk_timeline_draw_stand_in(GtkWidget *da, cairo_t *cr, const ImgTimelineBackground *background, gint tile)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineTile *slot;
+  gdouble scale, x;
+  gint i;
+
+  cairo_save(cr);
+  cairo_rectangle(cr, tile * TILE_WIDTH, 0, TILE_WIDTH, TILE_HEIGHT);
+  cairo_clip(cr);
+  gtk_timeline_draw_tracks(background, cr);
+  for (i = 0; i < TILE_SLOTS; i++)
+  {
+    slot = &priv->tiles[i];
+    if (slot->surface == NULL)
+      continue;
+    scale = priv->pixels_per_second / slot->pixels_per_second;
+    x = slot->index * TILE_WIDTH * scale;
+    if (x >= (tile + 1) * TILE_WIDTH || x + TILE_WIDTH * scale <= tile * TILE_WIDTH)
+      continue;
+
+    cairo_save(cr);
+    cairo_translate(cr, x, 0);
+    cairo_scale(cr, scale, 1);
+    cairo_set_source_surface(cr, slot->surface, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+    cairo_rectangle(cr, 0, 0, TILE_WIDTH, TILE_HEIGHT);
+    cairo_fill(cr);
+    cairo_restore(cr);
+  }
+  cairo_restore(cr);
+}
+
+static void gtk_timeline_queue_tile(GtkWidget *da, const ImgTimelineBackground *background, gint tile)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineTileJob *job;
+  ImgTimelineTile *slot;
+  GdkWindow *window;
+
+  job = g_slice_new0(ImgTimelineTileJob);
+  job->timeline = (ImgTimeline*)da;
+  job->tile = tile;
+  job->serial = priv->tiles_serial;
+  job->background = *background;
+  job->background.labels.font = cairo_scaled_font_reference(background->labels.font);
+  //Made here for the scale of the window, the worker only draws on it
+  window = gtk_widget_get_window(da);
+  if (window)
+    job->surface = gdk_window_create_similar_image_surface(window, CAIRO_FORMAT_ARGB32, TILE_WIDTH, TILE_HEIGHT, gtk_widget_get_scale_factor(da));
+  else
+    job->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, TILE_WIDTH, TILE_HEIGHT);
+
+  slot = &priv->tiles[tile % TILE_SLOTS];
+  slot->queued = tile;
+  slot->queued_serial = job->serial;
+  g_thread_pool_push(priv->tile_pool, job, NULL);
+}
+
+static void gtk_timeline_tile_thread(gpointer data, gpointer user_data)
+{
+  ImgTimelineTileJob *job = data;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(job->timeline);
+  cairo_t *cr;
+
+  //Stale already, a zoom went by while it was waiting
+  if (job->serial == g_atomic_int_get(&priv->tiles_serial))
+  {
+    job->render_time = g_get_monotonic_time();
+    cr = cairo_create(job->surface);
+    cairo_translate(cr, -job->tile * TILE_WIDTH, 0);
+    cairo_rectangle(cr, job->tile * TILE_WIDTH, 0, TILE_WIDTH, TILE_HEIGHT);
+    cairo_clip(cr);
+    gtk_timeline_draw_background(&job->background, cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(job->surface);
+    job->render_time = g_get_monotonic_time() - job->render_time;
+    job->drawn = TRUE;
+  }
+
+  g_mutex_lock(&priv->tile_lock);
+  g_ptr_array_add(priv->tiled, job);
+  if (priv->tile_idle == 0)
+    priv->tile_idle = g_idle_add(gtk_timeline_tile_flush, job->timeline);
+  g_mutex_unlock(&priv->tile_lock);
+}
+
+//Puts the finished tiles in their slots and repaints just them
+static gboolean gtk_timeline_tile_flush(gpointer data)
+{
+  ImgTimeline *da = data;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineTileJob *job;
+  ImgTimelineTile *slot;
+  GPtrArray *tiled;
+  guint i;
+
+  g_mutex_lock(&priv->tile_lock);
+  tiled = priv->tiled;
+  priv->tiled = g_ptr_array_new();
+  priv->tile_idle = 0;
+  g_mutex_unlock(&priv->tile_lock);
+
+  for (i = 0; i < tiled->len; i++)
+  {
+    job = g_ptr_array_index(tiled, i);
+    slot = &priv->tiles[job->tile % TILE_SLOTS];
+    if (slot->queued == job->tile && slot->queued_serial == job->serial)
+      slot->queued = -1;
+    //Added here, the histograms are only touched on the main thread
+    if (job->drawn && priv->stats_enabled)
+      gtk_timeline_stats_add(&priv->stats.tile_render, job->render_time);
+    if (job->drawn && job->serial == priv->tiles_serial)
+    {
+      if (slot->surface)
+        cairo_surface_destroy(slot->surface);
+      slot->surface = job->surface;
+      slot->index = job->tile;
+      slot->serial = job->serial;
+      slot->pixels_per_second = job->background.pixels_per_second;
+      job->surface = NULL;
+      gtk_timeline_queue_draw_span(GTK_WIDGET(da), job->tile * TILE_WIDTH, (job->tile + 1) * TILE_WIDTH, 0, TILE_HEIGHT);
+    }
+    gtk_timeline_tile_job_free(job);
+  }
+  g_ptr_array_free(tiled, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void gtk_timeline_tile_job_free(ImgTimelineTileJob *job)
+{
+  if (job->surface)
+    cairo_surface_destroy(job->surface);
+  cairo_scaled_font_destroy(job->background.labels.font);
+  g_slice_free(ImgTimelineTileJob, job);
+}
+
+//The cached tiles are kept as stand-ins until they are drawn again
+static void gtk_timeline_invalidate_tiles(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_atomic_int_inc(&priv->tiles_serial);
+  gtk_timeline_queue_draw_visible(GTK_WIDGET(da));
+}
+
+static void gtk_timeline_finalize(GObject *object)
+{ 
+  ImgTimeline *da = GTK_TIMELINE(object);
+  ImgTimelinePrivate *priv =gtk_timeline_get_instance_private(da);
+  guint i;
+  
+  g_free(priv->video_background_string);
+  g_free(priv->audio_background_string);
+  
+  //The queued tiles see they are stale and skip the drawing
+  g_atomic_int_inc(&priv->tiles_serial);
+  g_thread_pool_free(priv->tile_pool, FALSE, TRUE);
+  if (priv->tile_idle)
+    g_source_remove(priv->tile_idle);
+  g_ptr_array_foreach(priv->tiled, (GFunc)gtk_timeline_tile_job_free, NULL);
+  g_ptr_array_free(priv->tiled, TRUE);
+  g_mutex_clear(&priv->tile_lock);
+  for (i = 0; i < TILE_SLOTS; i++)
+    if (priv->tiles[i].surface)
+      cairo_surface_destroy(priv->tiles[i].surface);
+
+  if(priv->labels.font != NULL)
+    cairo_scaled_font_destroy(priv->labels.font);
+
+  if (priv->flash_timeout)
+    g_source_remove(priv->flash_timeout);
+  if (priv->flash)
+    cairo_region_destroy(priv->flash);
+  if (priv->flash_clear)
+    cairo_region_destroy(priv->flash_clear);
+  if (priv->stats_timeout)
+    g_source_remove(priv->stats_timeout);
+
+  g_signal_handlers_disconnect_by_func(priv->hadjustment, gtk_timeline_hadjustment_changed, da);
+  g_object_unref(priv->hadjustment);
+  g_object_unref(priv->vadjustment);
+
+  //Let the queued jobs see the cancellation and drop what they return
+  g_cancellable_cancel(priv->decode_cancellable);
+  g_thread_pool_free(priv->decode_pool, FALSE, TRUE);
+  if (priv->decode_idle)
+    g_source_remove(priv->decode_idle);
+  g_ptr_array_foreach(priv->decoded, (GFunc)gtk_timeline_decode_job_free, NULL);
+  g_ptr_array_free(priv->decoded, TRUE);
+  g_mutex_clear(&priv->decode_lock);
+  g_object_unref(priv->decode_cancellable);
+  for (i = 0; i < priv->clips.len; i++)
+    gtk_timeline_thumb_free(da, priv->clips.thumb[i]);
+  gtk_timeline_clip_store_clear(&priv->clips);
+  for (i = 0; i < priv->audio_clips.len; i++)
+    gtk_timeline_audio_free(priv->audio_clips.thumb[i]);
+  gtk_timeline_clip_store_clear(&priv->audio_clips);
+
+  G_OBJECT_CLASS(gtk_timeline_parent_class)->finalize(object);
+}
+
+static void gtk_timeline_get_visible_range(GtkWidget *da, cairo_t *cr, gdouble *x1, gdouble *x2)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gdouble y1, y2, page_x1, page_x2;
+
+  cairo_clip_extents(cr, x1, &y1, x2, &y2);
+  if (priv->exporting)
+    return;
+  gtk_timeline_get_page(da, &page_x1, &page_x2);
+  *x1 = MAX(*x1, page_x1);
+  *x2 = MIN(*x2, page_x2);
+}
+
+//The part of the timeline that can be seen, in timeline pixels
+static void gtk_timeline_get_page(GtkWidget *da, gdouble *x1, gdouble *x2)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  *x1 = gtk_timeline_get_offset(priv);
+  *x2 = *x1 + gtk_widget_get_allocated_width(da);
+}
+
+//The widget is only the page, whatever has to be redrawn everywhere is
+static void gtk_timeline_queue_draw_visible(GtkWidget *da)
+{
+  gtk_widget_queue_draw(da);
+}
+
+//Damages x1 to x2 in timeline pixels, what falls off the page is dropped
+static void gtk_timeline_queue_draw_span(GtkWidget *da, gdouble x1, gdouble x2, gint y, gint height)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gdouble offset = gtk_timeline_get_offset(priv);
+
+  x1 = MAX(floor(x1 - offset), 0);
+  x2 = MIN(ceil(x2 - offset), gtk_widget_get_allocated_width(da));
+  if (x2 > x1)
+    gtk_widget_queue_draw_area(da, x1, y, x2 - x1, height);
+}
+
+static void gtk_timeline_queue_draw_marker(GtkWidget *da, gint posx)
+{
+  gtk_timeline_queue_draw_span(da, posx - MARKER_SPILL, posx + MARKER_WIDTH + MARKER_SPILL, MARKER_Y - MARKER_SPILL, MARKER_HEIGHT + 2 * MARKER_SPILL);
+}
+
+static void gtk_timeline_flash_damage(GtkWidget *da, cairo_t *cr)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  cairo_rectangle_list_t *list;
+  cairo_rectangle_int_t rect;
+  cairo_region_t *region;
+  gint i;
+
+  list = cairo_copy_clip_rectangle_list(cr);
+  if (list->status != CAIRO_STATUS_SUCCESS)
+  {
+    cairo_rectangle_list_destroy(list);
+    return;
+  }
+  region = cairo_region_create();
+  for (i = 0; i < list->num_rectangles; i++)
+  {
+    rect.x = floor(list->rectangles[i].x);
+    rect.y = floor(list->rectangles[i].y);
+    rect.width = ceil(list->rectangles[i].x + list->rectangles[i].width) - rect.x;
+    rect.height = ceil(list->rectangles[i].y + list->rectangles[i].height) - rect.y;
+    cairo_region_union_rectangle(region, &rect);
+  }
+  cairo_rectangle_list_destroy(list);
+
+  //What is repainted to clear the last flash doesn't flash again
+  if (priv->flash_clear)
+  {
+    cairo_region_subtract(region, priv->flash_clear);
+    cairo_region_destroy(priv->flash_clear);
+    priv->flash_clear = NULL;
+  }
+  if (cairo_region_is_empty(region))
+  {
+    cairo_region_destroy(region);
+    return;
+  }
+
+  cairo_save(cr);
+  cairo_set_source_rgba(cr, 1, 0, 1, 0.3);
+  for (i = 0; i < cairo_region_num_rectangles(region); i++)
+  {
+    cairo_region_get_rectangle(region, i, &rect);
+    cairo_rectangle(cr, rect.x, rect.y, rect.width, rect.height);
+  }
+  cairo_fill(cr);
+  cairo_restore(cr);
+
+  if (priv->flash == NULL)
+    priv->flash = region;
+  else
+  {
+    cairo_region_union(priv->flash, region);
+    cairo_region_destroy(region);
+  }
+  if (priv->flash_timeout == 0)
+    priv->flash_timeout = g_timeout_add(FLASH_TIME, gtk_timeline_flash_timeout, da);
+}
+
+static gboolean gtk_timeline_flash_timeout(gpointer data)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)data);
+
+  priv->flash_timeout = 0;
+  gtk_widget_queue_draw_region(GTK_WIDGET(data), priv->flash);
+  if (priv->flash_clear == NULL)
+    priv->flash_clear = priv->flash;
+  else
+  {
+    cairo_region_union(priv->flash_clear, priv->flash);
+    cairo_region_destroy(priv->flash);
+  }
+  priv->flash = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+//Returns the time now to start the next phase from, phase is only timed
+//from since when it's a real one
+static gint64 gtk_timeline_stats_phase(ImgTimelinePrivate *priv, ImgTimelinePhase phase, gint64 since)
+{
+  gint64 now;
+
+  if ( ! priv->stats_enabled)
+    return 0;
+
+  now = g_get_monotonic_time();
+  if (phase < GTK_TIMELINE_N_PHASES)
+    gtk_timeline_stats_add(&priv->stats.draw[phase], now - since);
+  return now;
+}
+
+static void gtk_timeline_stats_add(ImgTimelineHistogram *histogram, guint64 value)
+{
+  histogram->count++;
+  histogram->sum += value;
+  histogram->max = MAX(histogram->max, value);
+  histogram->buckets[value > 0 ? MIN(GTK_TIMELINE_HISTOGRAM_BUCKETS - 1, g_bit_storage(value)) : 0]++;
+}
+
+//Every decode job goes to the workers through here
+static void gtk_timeline_stats_push(ImgTimeline *da, ImgTimelineDecodeJob *job)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  if (priv->stats_enabled)
+  {
+    gtk_timeline_stats_add(&priv->stats.decode_queue, g_thread_pool_unprocessed(priv->decode_pool));
+    job->queued = g_get_monotonic_time();
+  }
+  g_thread_pool_push(priv->decode_pool, job, NULL);
+}
+
+static void gtk_timeline_draw_stats(GtkWidget *da, cairo_t *cr)
+{
+  static const gchar *names[GTK_TIMELINE_N_PHASES] = { "tiles", "slides", "audio", "marker", "frame" };
+  ImgTimelineStats stats;
+  ImgTimelineHistogram *histogram;
+  gchar line[128];
+  gdouble x2, y;
+  guint64 draws;
+  gint i;
+
+  gtk_timeline_get_stats((ImgTimeline*)da, &stats);
+  x2 = gtk_widget_get_allocated_width(da);
+
+  cairo_save(cr);
+  cairo_rectangle(cr, x2 - STATS_WIDTH, 0, STATS_WIDTH, STATS_HEIGHT);
+  cairo_set_source_rgba(cr, 0, 0, 0, 0.75);
+  cairo_fill(cr);
+  cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, 10);
+  cairo_set_source_rgb(cr, 1, 1, 1);
+
+  y = STATS_LINE;
+  for (i = 0; i < GTK_TIMELINE_N_PHASES; i++, y += STATS_LINE)
+  {
+    histogram = &stats.draw[i];
+    g_snprintf(line, sizeof(line), "%-7s p50 %6" G_GUINT64_FORMAT " p99 %6" G_GUINT64_FORMAT " max %7" G_GUINT64_FORMAT " us",
+               names[i], gtk_timeline_histogram_percentile(histogram, 0.5), gtk_timeline_histogram_percentile(histogram, 0.99), histogram->max);
+    cairo_move_to(cr, x2 - STATS_WIDTH + 6, y);
+    cairo_show_text(cr, line);
+  }
+
+  histogram = &stats.decode_latency;
+  g_snprintf(line, sizeof(line), "decode  p50 %6" G_GUINT64_FORMAT " p99 %6" G_GUINT64_FORMAT " max %7" G_GUINT64_FORMAT " ms",
+             gtk_timeline_histogram_percentile(histogram, 0.5) / 1000, gtk_timeline_histogram_percentile(histogram, 0.99) / 1000, histogram->max / 1000);
+  cairo_move_to(cr, x2 - STATS_WIDTH + 6, y);
+  cairo_show_text(cr, line);
+  y += STATS_LINE;
+
+  histogram = &stats.tile_render;
+  g_snprintf(line, sizeof(line), "render  p50 %6" G_GUINT64_FORMAT " p99 %6" G_GUINT64_FORMAT " max %7" G_GUINT64_FORMAT " us",
+             gtk_timeline_histogram_percentile(histogram, 0.5), gtk_timeline_histogram_percentile(histogram, 0.99), histogram->max);
+  cairo_move_to(cr, x2 - STATS_WIDTH + 6, y);
+  cairo_show_text(cr, line);
+  y += STATS_LINE;
+
+  histogram = &stats.decode_queue;
+  g_snprintf(line, sizeof(line), "queue   p50 %6" G_GUINT64_FORMAT " p99 %6" G_GUINT64_FORMAT " max %7" G_GUINT64_FORMAT " jobs",
+             gtk_timeline_histogram_percentile(histogram, 0.5), gtk_timeline_histogram_percentile(histogram, 0.99), histogram->max);
+  cairo_move_to(cr, x2 - STATS_WIDTH + 6, y);
+  cairo_show_text(cr, line);
+  y += STATS_LINE;
+
+  draws = stats.cache.hits + stats.cache.misses;
+  g_snprintf(line, sizeof(line), "cache   %5.1f%% hits %u thumbs %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " KB",
+             draws ? 100.0 * stats.cache.hits / draws : 0.0, stats.cache.resident, stats.cache.bytes / 1024, stats.cache.budget / 1024);
+  cairo_move_to(cr, x2 - STATS_WIDTH + 6, y);
+  cairo_show_text(cr, line);
+  cairo_restore(cr);
+}
+
+//Repaints only the overlay, the rest of the page keeps its own damage
+static gboolean gtk_timeline_stats_timeout(gpointer data)
+{
+  gint width = gtk_widget_get_allocated_width(GTK_WIDGET(data));
+
+  gtk_widget_queue_draw_area(GTK_WIDGET(data), width - STATS_WIDTH, 0, STATS_WIDTH, STATS_HEIGHT);
+
+  return G_SOURCE_CONTINUE;
+}
+
+//The levels of detail of the ruler, in frames: frames, seconds, 10 s, minutes and hours
+//In frames, then in timecode seconds of rate frames
+static const gint64 frame_steps[] = { 1, 5 };
+static const gint64 second_steps[] = { 1, 2, 5, 10, 30, 60, 5 * 60, 10 * 60, 30 * 60, 3600 };
+
+//The shortest step at least min_distance px wide that is a multiple of
+//multiple_of, so that the number of ticks on the page is about the same at
+//every scale
+static gint64 gtk_timeline_get_tick_step(gdouble pixels_per_frame, gint rate, gdouble min_distance, gint64 multiple_of)
+{
+  gint64 hours, step;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(frame_steps) && frame_steps[i] < rate; i++)
+    if (frame_steps[i] * pixels_per_frame >= min_distance && frame_steps[i] % multiple_of == 0)
+      return frame_steps[i];
+  for (i = 0; i < G_N_ELEMENTS(second_steps); i++)
+  {
+    step = second_steps[i] * rate;
+    if (step * pixels_per_frame >= min_distance && step % multiple_of == 0)
+      return step;
+  }
+
+  hours = ceil(min_distance / (3600 * rate * pixels_per_frame));
+  return MAX(1, hours) * 3600 * rate;
+}
+
+//The frame time is in, in integers so that it's exact for hours at 30000/1001.
+//Whole periods of frame_rate_den seconds hold frame_rate_num frames, only
+//what is left of one is scaled, so nothing goes past num * den even when
+//both are G_MAXINT
+static gint64 gtk_timeline_frame_at(gint64 time, gint frame_rate_num, gint frame_rate_den)
+{
+  gint64 seconds, rest;
+
+  time = MAX(0, time);
+  seconds = time / G_TIME_SPAN_SECOND;
+  rest = time % G_TIME_SPAN_SECOND;
+  return seconds / frame_rate_den * frame_rate_num
+         + (seconds % frame_rate_den * frame_rate_num + rest * frame_rate_num / G_TIME_SPAN_SECOND) / frame_rate_den;
+}
+
+//The first microsecond of frame, gtk_timeline_frame_at() of it is frame again.
+//Split the same way, the rest of a period in whole seconds and then in
+//microseconds rounded up
+static gint64 gtk_timeline_frame_start(gint64 frame, gint frame_rate_num, gint frame_rate_den)
+{
+  gint64 rest;
+
+  frame = MAX(0, frame);
+  rest = frame % frame_rate_num * frame_rate_den;
+  return frame / frame_rate_num * frame_rate_den * G_TIME_SPAN_SECOND
+         + rest / frame_rate_num * G_TIME_SPAN_SECOND
+         + (rest % frame_rate_num * G_TIME_SPAN_SECOND + frame_rate_num - 1) / frame_rate_num;
+}
+
+//The start of the nearest frame, where the marker goes when scrubbing
+static gint64 gtk_timeline_snap_to_frame(ImgTimelinePrivate *priv, gint64 time)
+{
+  gint64 frame, start, next;
+
+  frame = gtk_timeline_frame_at(time, priv->frame_rate_num, priv->frame_rate_den);
+  start = gtk_timeline_frame_start(frame, priv->frame_rate_num, priv->frame_rate_den);
+  next = gtk_timeline_frame_start(frame + 1, priv->frame_rate_num, priv->frame_rate_den);
+  return time - start < next - time ? start : next;
+}
+
+//Frames per timecode second, 30 for 30000/1001
+static gint gtk_timeline_timecode_rate(gint frame_rate_num, gint frame_rate_den)
+{
+  return MAX(1, ((gint64)frame_rate_num + frame_rate_den / 2) / frame_rate_den);
+}
+
+//On the main thread, before the first tile is queued
+static void gtk_timeline_cache_label_glyphs(ImgTimelineLabels *labels, cairo_t *cr)
+{
+  cairo_glyph_t *glyphs = NULL;
+  cairo_text_extents_t extents;
+  gint i, num_glyphs;
+
+  cairo_save(cr);
+  cairo_select_font_face(cr, "Ubuntu", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+  cairo_set_font_size(cr, 10);
+  labels->font = cairo_scaled_font_reference(cairo_get_scaled_font(cr));
+  cairo_restore(cr);
+
+  if (cairo_scaled_font_text_to_glyphs(labels->font, 0, 0, LABEL_CHARS, -1, &glyphs, &num_glyphs, NULL, NULL, NULL) != CAIRO_STATUS_SUCCESS)
+    return;
+
+  //One glyph per char is what we need to assemble the labels by hand
+  if (num_glyphs == LABEL_N_CHARS)
+  {
+    for (i = 0; i < LABEL_N_CHARS; i++)
+    {
+      cairo_scaled_font_glyph_extents(labels->font, &glyphs[i], 1, &extents);
+      labels->glyph[i] = glyphs[i].index;
+      labels->advance[i] = extents.x_advance;
+    }
+    labels->ready = TRUE;
+  }
+  cairo_glyph_free(glyphs);
+}
+
+//Appends the hh:mm:ss glyphs of frame, and :ff when frames is set, centered
+//on x, returns how many were added. rate is the timecode rate, ff has a
+//third digit above 100 frames per second
+static gint gtk_timeline_layout_label(const ImgTimelineLabels *labels, gint64 frame, gint rate, gboolean frames, gdouble x, cairo_glyph_t *glyphs)
+{
+  gint chars[LABEL_MAX_GLYPHS];
+  gint i, n = 0;
+  gint64 seconds, hours;
+  gdouble width = 0;
+
+  seconds = frame / rate;
+  hours = seconds / 3600;
+  do
+  {
+    chars[n++] = hours % 10;
+    hours /= 10;
+  } while (hours > 0 && n < LABEL_MAX_GLYPHS - 10);
+  if (n < 2)
+    chars[n++] = 0;
+
+  //The hours were written backwards
+  for (i = 0; i < n / 2; i++)
+  {
+    gint tmp = chars[i];
+    chars[i] = chars[n - 1 - i];
+    chars[n - 1 - i] = tmp;
+  }
+  chars[n++] = LABEL_COLON;
+  chars[n++] = (seconds / 60) % 60 / 10;
+  chars[n++] = (seconds / 60) % 10;
+  chars[n++] = LABEL_COLON;
+  chars[n++] = seconds % 60 / 10;
+  chars[n++] = seconds % 10;
+  if (frames)
+  {
+    chars[n++] = LABEL_COLON;
+    if (rate > 100)
+      chars[n++] = frame % rate / 100;
+    chars[n++] = frame % rate / 10 % 10;
+    chars[n++] = frame % rate % 10;
+  }
+
+  for (i = 0; i < n; i++)
+    width += labels->advance[chars[i]];
+
+  x -= width / 2;
+  for (i = 0; i < n; i++)
+  {
+    glyphs[i].index = labels->glyph[chars[i]];
+    glyphs[i].x = x;
+    glyphs[i].y = 0;
+    x += labels->advance[chars[i]];
+  }
+  return n;
+}
+
+static void gtk_timeline_draw_time_ticks(const ImgTimelineBackground *background, cairo_t *cr)
+{
+  const ImgTimelineLabels *labels = &background->labels;
+  cairo_glyph_t glyphs[LABEL_GLYPH_BATCH];
+  cairo_text_extents_t extents;
+  gchar time[32];
+  gint num_glyphs, rate;
+  gint64 i, first, last, frame, seconds, tick, label, total_frames;
+  gdouble pixels_per_frame, x, x1, x2, y1, y2;
+
+  //Pick the level of detail, labels go on every few ticks. The ticks are on
+  //the real frames, the labels count them in timecode
+  pixels_per_frame = background->pixels_per_second * background->frame_rate_den / background->frame_rate_num;
+  rate = gtk_timeline_timecode_rate(background->frame_rate_num, background->frame_rate_den);
+  tick = gtk_timeline_get_tick_step(pixels_per_frame, rate, TICK_MIN_DISTANCE, 1);
+  label = gtk_timeline_get_tick_step(pixels_per_frame, rate, LABEL_MIN_DISTANCE, tick);
+  total_frames = gtk_timeline_frame_at(background->duration, background->frame_rate_num, background->frame_rate_den);
+
+  cairo_set_source_rgb(cr, 0,0,0);
+  cairo_set_line_width(cr, 1);
+
+  //Only draw the ticks whose label can reach the clip area
+  cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+  first = MAX(0, floor((x1 - LABEL_HALF_WIDTH) / (tick * pixels_per_frame)));
+  last  = MIN(total_frames / tick, ceil((x2 + LABEL_HALF_WIDTH) / (tick * pixels_per_frame)));
+
+  //Draw the line markers, all of them with a single stroke, the labelled ones longer
+  for (i = first; i <= last; i++)
+  {
+    frame = i * tick;
+    x = floor(frame * pixels_per_frame) + 0.5;
+    cairo_move_to(cr, x, frame % label == 0 ? 4 : 14);
+    cairo_line_to(cr, x, 24);
+  }
+  cairo_stroke(cr);
+
+  //Draw the labels, each is known from its frame without walking the previous ones
+  cairo_set_scaled_font(cr, labels->font);
+  num_glyphs = 0;
+  for (frame = (first * tick + label - 1) / label * label; frame <= last * tick; frame += label)
+  {
+    x = floor(frame * pixels_per_frame) + 0.5;
+    if (labels->ready)
+    {
+      if (num_glyphs + LABEL_MAX_GLYPHS > LABEL_GLYPH_BATCH)
+      {
+        cairo_show_glyphs(cr, glyphs, num_glyphs);
+        num_glyphs = 0;
+      }
+      num_glyphs += gtk_timeline_layout_label(labels, frame, rate, label < rate, x, glyphs + num_glyphs);
+    }
+    else
+    {
+      seconds = frame / rate;
+      if (label < rate)
+        g_snprintf(time, sizeof(time), "%02d:%02d:%02d:%02d", (gint)(seconds / 3600), (gint)(seconds / 60 % 60), (gint)(seconds % 60), (gint)(frame % rate));
+      else
+        g_snprintf(time, sizeof(time), "%02d:%02d:%02d", (gint)(seconds / 3600), (gint)(seconds / 60 % 60), (gint)(seconds % 60));
+      cairo_text_extents(cr, time, &extents);
+      cairo_move_to(cr, x - extents.width / 2, 0);
+      cairo_show_text(cr, time);
+    }
+  }
+  if (num_glyphs > 0)
+    cairo_show_glyphs(cr, glyphs, num_glyphs);
+}
+
+void gtk_timeline_add_slide(GtkWidget *da, gchar *filename, gint x)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineClipStore *clips = &priv->clips;
+  gint64 start;
+
+  //Dropped slides are centered on the pointer, the others go after the last one
+  if (x > 0)
+    start = MAX(0, gtk_timeline_x_to_time(priv, x) - SLIDE_DURATION / 2);
+  else if (clips->len > 0)
+    start = clips->start[clips->len - 1] + clips->duration[clips->len - 1];
+  else
+    start = 0;
+
+  gtk_timeline_insert_clip((ImgTimeline*)da, filename, start, SLIDE_DURATION);
+}
+
+guint gtk_timeline_add_slides(ImgTimeline *da, gchar **filenames, gint64 start)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineClipStore *clips = &priv->clips;
+  gpointer *thumbs, dragged = NULL;
+  guint i, n, index;
+
+  n = g_strv_length(filenames);
+  if (priv->drag_clip >= 0)
+    dragged = clips->thumb[priv->drag_clip];
+  if (start < 0 && clips->len > 0)
+    start = clips->start[clips->len - 1] + clips->duration[clips->len - 1];
+  else if (start < 0)
+    start = 0;
+
+  //The slides go in the store in one merge and are notified once, their
+  //thumbnails are decoded when the page they are on is drawn
+  thumbs = g_new(gpointer, MAX(1, n));
+  for (i = 0; i < n; i++)
+    thumbs[i] = gtk_timeline_thumb_new(filenames[i]);
+  index = gtk_timeline_clip_store_insert_run(clips, start, SLIDE_DURATION, thumbs, n, 0);
+  g_free(thumbs);
+  //The dragged clip is pushed on by the slides merged in before it
+  if (dragged)
+    while (clips->thumb[priv->drag_clip] != dragged)
+      priv->drag_clip++;
+
+  gtk_timeline_clips_changed(da);
+  return index;
+}
+
+guint gtk_timeline_insert_clip(ImgTimeline *da, const gchar *filename, gint64 start, gint64 duration)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  guint index;
+
+  index = gtk_timeline_clip_store_insert(&priv->clips, start, duration, gtk_timeline_thumb_new(filename), 0);
+  if (priv->drag_clip >= (gint)index)
+    priv->drag_clip++;
+
+  gtk_timeline_clips_changed(da);
+  return index;
+}
+
+void gtk_timeline_remove_clip(ImgTimeline *da, guint index)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_if_fail(index < priv->clips.len);
+
+  gtk_timeline_thumb_free(da, priv->clips.thumb[index]);
+  gtk_timeline_clip_store_remove(&priv->clips, index);
+  if (priv->drag_clip == (gint)index)
+    priv->drag_clip = -1;
+  else if (priv->drag_clip > (gint)index)
+    priv->drag_clip--;
+
+  gtk_timeline_clips_changed(da);
+}
+
+guint gtk_timeline_move_clip(ImgTimeline *da, guint index, gint64 start)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  guint to;
+
+  g_return_val_if_fail(index < priv->clips.len, index);
+
+  if (priv->clips.start[index] == start)
+    return index;
+
+  //The clips between the old and the new place slide by one
+  to = gtk_timeline_clip_store_move(&priv->clips, index, start);
+  if (priv->drag_clip == (gint)index)
+    priv->drag_clip = to;
+  else if (index < to && priv->drag_clip > (gint)index && priv->drag_clip <= (gint)to)
+    priv->drag_clip--;
+  else if (to < index && priv->drag_clip >= (gint)to && priv->drag_clip < (gint)index)
+    priv->drag_clip++;
+
+  gtk_timeline_clips_changed(da);
+  return to;
+}
+
+guint gtk_timeline_get_n_clips(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  return priv->clips.len;
+}
+
+void gtk_timeline_get_clip(ImgTimeline *da, guint index, gint64 *start, gint64 *duration)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_if_fail(index < priv->clips.len);
+
+  if (start)
+    *start = priv->clips.start[index];
+  if (duration)
+    *duration = priv->clips.duration[index];
+}
+
+const gchar *gtk_timeline_get_clip_filename(ImgTimeline *da, guint index)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_val_if_fail(index < priv->clips.len, NULL);
+
+  return ((ImgTimelineThumb*)priv->clips.thumb[index])->filename;
+}
+
+void gtk_timeline_add_audio(GtkWidget *da, gchar *filename, gint x)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineClipStore *clips = &priv->audio_clips;
+  gint64 start;
+
+  //Dropped audio starts at the pointer, the rest goes after the last clip
+  if (x > 0)
+    start = MAX(0, gtk_timeline_x_to_time(priv, x));
+  else if (clips->len > 0)
+    start = clips->start[clips->len - 1] + clips->duration[clips->len - 1];
+  else
+    start = 0;
+
+  gtk_timeline_insert_audio_clip((ImgTimeline*)da, filename, start);
+}
+
+guint gtk_timeline_insert_audio_clip(ImgTimeline *da, const gchar *filename, gint64 start)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineAudio *audio;
+  ImgTimelineDecodeJob *job;
+  ImgTimelinePeaks *peaks;
+  gint sample_rate, channels;
+  gint64 frames;
+  guint index;
+
+  //Peaks saved by an earlier run are mapped right away, otherwise only the
+  //header is read here and the samples are reduced on the workers
+  peaks = gtk_timeline_peaks_load(filename);
+  if (peaks)
+  {
+    sample_rate = peaks->sample_rate;
+    frames = peaks->frames;
+  }
+  else if ( ! gtk_timeline_audio_probe(filename, &sample_rate, &channels, &frames))
+  {
+    g_warning("Can't read %s, only 16 bit PCM WAV files are supported", filename);
+    return G_MAXUINT;
+  }
+
+  audio = g_slice_new0(ImgTimelineAudio);
+  audio->filename = g_strdup(filename);
+  audio->peaks = peaks;
+  audio->cancellable = g_cancellable_new();
+  index = gtk_timeline_clip_store_insert(&priv->audio_clips, start, frames * G_TIME_SPAN_SECOND / sample_rate, audio, 0);
+
+  if (peaks == NULL)
+  {
+    audio->flags = THUMB_LOADING;
+    job = g_slice_new0(ImgTimelineDecodeJob);
+    job->timeline = da;
+    job->audio = audio;
+    job->filename = g_strdup(filename);
+    job->cancellable = g_object_ref(audio->cancellable);
+    gtk_timeline_stats_push(da, job);
+  }
+
+  gtk_timeline_clips_changed(da);
+  return index;
+}
+
+guint gtk_timeline_insert_audio_clip_full(ImgTimeline *da, const gchar *filename, gint64 start, gint64 duration)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineAudio *audio;
+  ImgTimelineDecodeJob *job;
+  guint index;
+
+  g_return_val_if_fail(duration > 0, G_MAXUINT);
+
+  audio = g_slice_new0(ImgTimelineAudio);
+  audio->filename = g_strdup(filename);
+  audio->flags = THUMB_LOADING;
+  audio->cancellable = g_cancellable_new();
+  index = gtk_timeline_clip_store_insert(&priv->audio_clips, start, duration, audio, 0);
+
+  job = g_slice_new0(ImgTimelineDecodeJob);
+  job->timeline = da;
+  job->audio = audio;
+  job->filename = g_strdup(filename);
+  job->cancellable = g_object_ref(audio->cancellable);
+  gtk_timeline_stats_push(da, job);
+
+  gtk_timeline_clips_changed(da);
+  return index;
+}
+
+void gtk_timeline_remove_audio_clip(ImgTimeline *da, guint index)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_if_fail(index < priv->audio_clips.len);
+
+  gtk_timeline_audio_free(priv->audio_clips.thumb[index]);
+  gtk_timeline_clip_store_remove(&priv->audio_clips, index);
+
+  gtk_timeline_clips_changed(da);
+}
+
+guint gtk_timeline_get_n_audio_clips(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  return priv->audio_clips.len;
+}
+
+void gtk_timeline_get_audio_clip(ImgTimeline *da, guint index, gint64 *start, gint64 *duration)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_if_fail(index < priv->audio_clips.len);
+
+  if (start)
+    *start = priv->audio_clips.start[index];
+  if (duration)
+    *duration = priv->audio_clips.duration[index];
+}
+
+const gchar *gtk_timeline_get_audio_clip_filename(ImgTimeline *da, guint index)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_val_if_fail(index < priv->audio_clips.len, NULL);
+
+  return ((ImgTimelineAudio*)priv->audio_clips.thumb[index])->filename;
+}
+
+static void gtk_timeline_audio_free(ImgTimelineAudio *audio)
+{
+  //Like for the thumbnails, a queued job sees this and drops its peaks
+  g_cancellable_cancel(audio->cancellable);
+  g_object_unref(audio->cancellable);
+  gtk_timeline_peaks_free(audio->peaks);
+  g_free(audio->filename);
+  g_slice_free(ImgTimelineAudio, audio);
+}
+
+void gtk_timeline_begin_update(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  priv->update_depth++;
+}
+
+void gtk_timeline_end_update(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+
+  g_return_if_fail(priv->update_depth > 0);
+
+  priv->update_depth--;
+  gtk_timeline_clips_changed(da);
+}
+
+static void gtk_timeline_clips_changed(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint64 start, end, audio_start, audio_end;
+  gboolean video, audio;
+
+  if (priv->update_depth > 0)
+    return;
+
+  //The union of where the changed clips were and are now, on their track
+  video = gtk_timeline_clip_store_take_dirty(&priv->clips, &start, &end);
+  if (video)
+    gtk_timeline_queue_draw_span(GTK_WIDGET(da), floor(gtk_timeline_time_to_x(priv, start)), floor(gtk_timeline_time_to_x(priv, end)) + 1, SLIDE_Y, SLIDE_HEIGHT);
+  audio = gtk_timeline_clip_store_take_dirty(&priv->audio_clips, &audio_start, &audio_end);
+  if (audio)
+    gtk_timeline_queue_draw_span(GTK_WIDGET(da), floor(gtk_timeline_time_to_x(priv, audio_start)), floor(gtk_timeline_time_to_x(priv, audio_end)) + 1, AUDIO_Y, AUDIO_HEIGHT);
+
+  //One "changed" for both tracks
+  if (video && audio)
+    g_signal_emit(da, timeline_signals[CHANGED], 0, MIN(start, audio_start), MAX(end, audio_end));
+  else if (video || audio)
+    g_signal_emit(da, timeline_signals[CHANGED], 0, video ? start : audio_start, video ? end : audio_end);
+}
+
+//The slide is painted as a placeholder until it's drawn for the first time
+//and its thumbnail is decoded. The cancellable is only made then too, a
+//loaded project may have clips that are never seen
+static ImgTimelineThumb *gtk_timeline_thumb_new(const gchar *filename)
+{
+  ImgTimelineThumb *thumb;
+
+  thumb = g_slice_new0(ImgTimelineThumb);
+  thumb->filename = g_strdup(filename);
+  thumb->lru_link.data = thumb;
+
+  return thumb;
+}
+
+static void gtk_timeline_thumb_free(ImgTimeline *da, ImgTimelineThumb *thumb)
+{
+  //A job still queued for the thumbnail sees this and never touches it again
+  if (thumb->cancellable)
+  {
+    g_cancellable_cancel(thumb->cancellable);
+    g_object_unref(thumb->cancellable);
+  }
+  gtk_timeline_thumb_evict(da, thumb);
+  g_free(thumb->filename);
+  g_slice_free(ImgTimelineThumb, thumb);
+}
+
+//A miss, the thumbnail is decoded again on the workers like the first time
+static void gtk_timeline_thumb_request(ImgTimeline *da, ImgTimelineThumb *thumb)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineDecodeJob *job;
+
+  priv->cache_misses++;
+  thumb->flags |= THUMB_LOADING;
+
+  job = g_slice_new0(ImgTimelineDecodeJob);
+  job->timeline = da;
+  job->thumb = thumb;
+  job->filename = g_strdup(thumb->filename);
+  if (thumb->cancellable == NULL)
+    thumb->cancellable = g_cancellable_new();
+  job->cancellable = g_object_ref(thumb->cancellable);
+  gtk_timeline_stats_push(da, job);
+}
+
+static void gtk_timeline_thumb_evict(ImgTimeline *da, ImgTimelineThumb *thumb)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint i;
+
+  if (thumb->mip[0] == NULL)
+    return;
+
+  for (i = 0; i < MIP_LEVELS; i++)
+    if (thumb->mip[i])
+    {
+      cairo_surface_destroy(thumb->mip[i]);
+      thumb->mip[i] = NULL;
+    }
+  if (thumb->filmstrip)
+  {
+    cairo_pattern_destroy(thumb->filmstrip);
+    thumb->filmstrip = NULL;
+  }
+  g_queue_unlink(&priv->lru, &thumb->lru_link);
+  priv->cache_bytes -= thumb->bytes;
+  thumb->bytes = 0;
+}
+
+//Evicts the least recently drawn thumbnails until the cache fits its
+//budget again, skipping the ones on the page
+static void gtk_timeline_cache_trim(ImgTimeline *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineThumb *thumb;
+  GList *link, *next;
+  gdouble x1, x2;
+
+  if (priv->cache_bytes <= priv->cache_budget)
+    return;
+
+  priv->visible_serial++;
+  gtk_timeline_get_page(GTK_WIDGET(da), &x1, &x2);
+  gtk_timeline_cache_mark_visible(da, x1, x2, 0, FALSE);
+  if (priv->drag_clip >= 0)
+    gtk_timeline_cache_mark_visible(da, x1, x2, priv->drag_delta, TRUE);
+
+  for (link = priv->lru.head; link && priv->cache_bytes > priv->cache_budget; link = next)
+  {
+    next = link->next;
+    thumb = link->data;
+    if (thumb->visible_serial != priv->visible_serial)
+    {
+      gtk_timeline_thumb_evict(da, thumb);
+      priv->cache_evictions++;
+    }
+  }
+}
+
+static void gtk_timeline_cache_mark_visible(ImgTimeline *da, gdouble x1, gdouble x2, gint64 offset, gboolean dragged)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  guint i, first, last;
+  gint64 start;
+
+  start = gtk_timeline_x_to_time(priv, x1) - offset;
+  gtk_timeline_clip_store_query(&priv->clips, start, gtk_timeline_x_to_time(priv, x2) - offset, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->clips, i + 1, start, last))
+    if (((priv->clips.flags[i] & CLIP_DRAGGED) != 0) == dragged)
+      ((ImgTimelineThumb*)priv->clips.thumb[i])->visible_serial = priv->visible_serial;
+}
+
+static void gtk_timeline_decode_thread(gpointer data, gpointer user_data)
+{
+  ImgTimelineDecodeJob *job = data;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(job->timeline);
+
+  if ( ! g_cancellable_is_cancelled(job->cancellable) && ! g_cancellable_is_cancelled(priv->decode_cancellable))
+  {
+    if (job->audio)
+    {
+      //Saved for the next time the file is added
+      job->peaks = gtk_timeline_peaks_load(job->filename);
+      if (job->peaks == NULL)
+      {
+        job->peaks = gtk_timeline_peaks_from_wav(job->filename, job->cancellable);
+        if (job->peaks)
+          gtk_timeline_peaks_save(job->peaks, job->filename);
+      }
+    }
+    else
+      job->pix[0] = gtk_timeline_thumbnail_load(job->filename, SLIDE_HEIGHT - 2 * SLIDE_PADDING, job->cancellable);
+  }
+
+  //Down here and not on the main loop
+  gtk_timeline_thumb_scale(job->pix);
+
+  g_mutex_lock(&priv->decode_lock);
+  g_ptr_array_add(priv->decoded, job);
+  if (priv->decode_idle == 0 && ! g_cancellable_is_cancelled(priv->decode_cancellable))
+    priv->decode_idle = g_idle_add(gtk_timeline_decode_flush, job->timeline);
+  g_mutex_unlock(&priv->decode_lock);
+}
+
+//Every level is half the previous one
+static void gtk_timeline_thumb_scale(GdkPixbuf **pix)
+{
+  gint i;
+
+  for (i = 1; i < MIP_LEVELS && pix[i - 1]; i++)
+    pix[i] = gdk_pixbuf_scale_simple(pix[i - 1], MAX(1, gdk_pixbuf_get_width(pix[i - 1]) / 2),
+                                     MAX(1, gdk_pixbuf_get_height(pix[i - 1]) / 2), GDK_INTERP_BILINEAR);
+}
+
+//Hands the decoded levels to the thumbnail, which enters the cache
+static void gtk_timeline_thumb_set(ImgTimeline *da, ImgTimelineThumb *thumb, GdkPixbuf **pix)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint l;
+
+  thumb->flags &= ~THUMB_LOADING;
+  if (pix[0] == NULL)
+    thumb->flags |= THUMB_MISSING;
+  for (l = 0; l < MIP_LEVELS && pix[l]; l++)
+  {
+    thumb->mip[l] = gdk_cairo_surface_create_from_pixbuf(pix[l], 1, gtk_widget_get_window(GTK_WIDGET(da)));
+    thumb->width[l] = gdk_pixbuf_get_width(pix[l]);
+    thumb->height[l] = gdk_pixbuf_get_height(pix[l]);
+    thumb->bytes += thumb->width[l] * thumb->height[l] * 4;
+  }
+  if (thumb->mip[0])
+  {
+    g_queue_push_tail_link(&priv->lru, &thumb->lru_link);
+    priv->cache_bytes += thumb->bytes;
+  }
+}
+
+static gboolean gtk_timeline_decode_flush(gpointer data)
+{
+  ImgTimeline *da = data;
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  ImgTimelineDecodeJob *batch[DECODE_BATCH];
+  guint i, n;
+  gboolean more;
+
+  g_mutex_lock(&priv->decode_lock);
+  n = MIN(priv->decoded->len, DECODE_BATCH);
+  for (i = 0; i < n; i++)
+    batch[i] = g_ptr_array_index(priv->decoded, i);
+  g_ptr_array_remove_range(priv->decoded, 0, n);
+  more = priv->decoded->len > 0;
+  if ( ! more)
+    priv->decode_idle = 0;
+  g_mutex_unlock(&priv->decode_lock);
+
+  for (i = 0; i < n; i++)
+  {
+    ImgTimelineDecodeJob *job = batch[i];
+
+    if (g_cancellable_is_cancelled(job->cancellable))
+    {
+      gtk_timeline_decode_job_free(job);
+      continue;
+    }
+    if (job->queued && priv->stats_enabled)
+      gtk_timeline_stats_add(&priv->stats.decode_latency, g_get_monotonic_time() - job->queued);
+    //An export read it meanwhile
+    if (job->audio ? job->audio->peaks != NULL : job->thumb->mip[0] != NULL)
+    {
+      gtk_timeline_decode_job_free(job);
+      continue;
+    }
+    if (job->audio)
+    {
+      job->audio->flags &= ~THUMB_LOADING;
+      if (job->peaks == NULL)
+        job->audio->flags |= THUMB_MISSING;
+      job->audio->peaks = job->peaks;
+      job->peaks = NULL;
+      gtk_timeline_decode_job_free(job);
+      continue;
+    }
+    gtk_timeline_thumb_set(da, job->thumb, job->pix);
+    gtk_timeline_decode_job_free(job);
+  }
+  //The thumbnails don't know their clips, the page is cheap to repaint anyway
+  if (n > 0)
+  {
+    gtk_timeline_cache_trim(da);
+    gtk_timeline_queue_draw_visible(GTK_WIDGET(da));
+  }
+
+  return more ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void gtk_timeline_decode_job_free(ImgTimelineDecodeJob *job)
+{
+  gint i;
+
+  for (i = 0; i < MIP_LEVELS; i++)
+    if (job->pix[i])
+      g_object_unref(job->pix[i]);
+  gtk_timeline_peaks_free(job->peaks);
+  g_object_unref(job->cancellable);
+  g_free(job->filename);
+  g_slice_free(ImgTimelineDecodeJob, job);
+}
+
+static gdouble gtk_timeline_time_to_x(ImgTimelinePrivate *priv, gint64 time)
+{
+  return time * priv->pixels_per_second / G_TIME_SPAN_SECOND;
+}
+
+static gint64 gtk_timeline_x_to_time(ImgTimelinePrivate *priv, gdouble x)
+{
+  return x * G_TIME_SPAN_SECOND / priv->pixels_per_second;
+}
+
+static void gtk_timeline_get_clip_extents(ImgTimelinePrivate *priv, guint index, gint *x, gint *width)
+{
+  gint64 start = priv->clips.start[index];
+
+  if (priv->clips.flags[index] & CLIP_DRAGGED)
+    start += priv->drag_delta;
+
+  //Both edges are rounded the same way so that clips back to back don't overlap
+  *x = floor(gtk_timeline_time_to_x(priv, start));
+  *width = floor(gtk_timeline_time_to_x(priv, start + priv->clips.duration[index])) - *x;
+}
+
+static void gtk_timeline_draw_slides(GtkWidget *da, cairo_t *cr)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gdouble x1, x2;
+
+  //The dragged clips are looked up where they were and drawn on top
+  gtk_timeline_get_visible_range(da, cr, &x1, &x2);
+  gtk_timeline_draw_clip_range(da, cr, x1, x2, 0, FALSE);
+  if (priv->drag_clip >= 0)
+    gtk_timeline_draw_clip_range(da, cr, x1, x2, priv->drag_delta, TRUE);
+
+  //An export trims between its strips, not while one is half drawn
+  if ( ! priv->exporting)
+    gtk_timeline_cache_trim((ImgTimeline*)da);
+}
+
+static void gtk_timeline_draw_clip_range(GtkWidget *da, cairo_t *cr, gdouble x1, gdouble x2, gint64 offset, gboolean dragged)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gint x, width;
+  guint i, first, last;
+  gint64 start;
+
+  //A pixel more on both sides for the rounding of the clip edges
+  start = gtk_timeline_x_to_time(priv, x1 - 1) - offset;
+  gtk_timeline_clip_store_query(&priv->clips, start, gtk_timeline_x_to_time(priv, x2 + 1) - offset, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->clips, i + 1, start, last))
+  {
+    if (((priv->clips.flags[i] & CLIP_DRAGGED) != 0) != dragged)
+      continue;
+    gtk_timeline_get_clip_extents(priv, i, &x, &width);
+    if (x + width >= x1 && x <= x2)
+      gtk_timeline_draw_slide((ImgTimeline*)da, cr, priv->clips.thumb[i], priv->clips.flags[i], x, width);
+  }
+}
+
+static void gtk_timeline_draw_slide(ImgTimeline *da, cairo_t *cr, ImgTimelineThumb *thumb, guint32 flags, gint x, gint width)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  gint inner_x, inner_y, inner_width, inner_height, level, span_x, span_width;
+
+  //Drawing a thumbnail makes it the most recently used one
+  if (thumb->mip[0])
+  {
+    priv->cache_hits++;
+    g_queue_unlink(&priv->lru, &thumb->lru_link);
+    g_queue_push_tail_link(&priv->lru, &thumb->lru_link);
+  }
+  //An export has read its thumbnails already, the workers aren't asked
+  else if ( ! priv->exporting && (thumb->flags & (THUMB_LOADING | THUMB_MISSING)) == 0)
+    gtk_timeline_thumb_request(da, thumb);
+
+  cairo_save(cr);
+  cairo_set_line_width(cr, 1);
+  span_x = x;
+  span_width = width;
+  gtk_timeline_clip_span(cr, &span_x, &span_width);
+  cairo_rectangle(cr, span_x + 0.5, SLIDE_Y + 0.5, span_width - 1, SLIDE_HEIGHT - 1);
+  if (flags & CLIP_SELECTED)
+    cairo_set_source_rgb(cr, 0.55, 0.55, 0.55);
+  else
+    cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+  cairo_fill_preserve(cr);
+  cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+  cairo_stroke(cr);
+
+  inner_x = x + SLIDE_PADDING;
+  inner_y = SLIDE_Y + SLIDE_PADDING;
+  inner_width = width - 2 * SLIDE_PADDING;
+  inner_height = SLIDE_HEIGHT - 2 * SLIDE_PADDING;
+  if (inner_width <= 0)
+  {
+    cairo_restore(cr);
+    return;
+  }
+  span_x = inner_x;
+  span_width = inner_width;
+  gtk_timeline_clip_span(cr, &span_x, &span_width);
+  cairo_rectangle(cr, span_x, inner_y, span_width, inner_height);
+  cairo_clip(cr);
+
+  //A filmstrip when the clip has room for two thumbnails, otherwise the
+  //largest level that fits so that zooming out doesn't squeeze a 50 px
+  //thumbnail in a sliver
+  if (thumb->mip[0] && inner_width >= 2 * (thumb->width[0] + FILMSTRIP_GAP))
+    gtk_timeline_draw_filmstrip(da, cr, thumb, inner_x, inner_y, inner_width, inner_height);
+  else if (thumb->mip[0])
+  {
+    for (level = 0; level < MIP_LEVELS - 1 && thumb->mip[level + 1]; level++)
+      if (thumb->width[level] <= inner_width)
+        break;
+    cairo_set_source_surface(cr, thumb->mip[level], inner_x + (inner_width - thumb->width[level]) / 2, inner_y + (inner_height - thumb->height[level]) / 2);
+    cairo_paint(cr);
+  }
+  else if ((thumb->flags & THUMB_MISSING) && inner_x + inner_width / 2 + 10 >= span_x && inner_x + inner_width / 2 - 10 <= span_x + span_width)
+  {
+    //Cross out the slides whose image could not be loaded
+    cairo_set_source_rgb(cr, 0.8, 0, 0);
+    cairo_set_line_width(cr, 2);
+    cairo_move_to(cr, inner_x + inner_width / 2 - 10, inner_y + inner_height / 2 - 10);
+    cairo_rel_line_to(cr, 20, 20);
+    cairo_move_to(cr, inner_x + inner_width / 2 + 10, inner_y + inner_height / 2 - 10);
+    cairo_rel_line_to(cr, -20, 20);
+    cairo_stroke(cr);
+  }
+  cairo_restore(cr);
+}
+
+//One fill with a repeating pattern, however long the clip, cairo only
+//rasterizes what is inside the clip area
+static void gtk_timeline_draw_filmstrip(ImgTimeline *da, cairo_t *cr, ImgTimelineThumb *thumb, gint x, gint y, gint width, gint height)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private(da);
+  cairo_surface_t *tile;
+  cairo_matrix_t matrix;
+  cairo_t *tile_cr;
+  gint span_x, span_width, period;
+
+  if (thumb->filmstrip == NULL)
+  {
+    tile = cairo_surface_create_similar(thumb->mip[0], CAIRO_CONTENT_COLOR_ALPHA, thumb->width[0] + FILMSTRIP_GAP, height);
+    tile_cr = cairo_create(tile);
+    cairo_set_source_rgb(tile_cr, 0.2, 0.2, 0.2);
+    cairo_paint(tile_cr);
+    cairo_set_source_surface(tile_cr, thumb->mip[0], FILMSTRIP_GAP / 2, (height - thumb->height[0]) / 2);
+    cairo_paint(tile_cr);
+    cairo_destroy(tile_cr);
+
+    thumb->filmstrip = cairo_pattern_create_for_surface(tile);
+    cairo_pattern_set_extend(thumb->filmstrip, CAIRO_EXTEND_REPEAT);
+    cairo_surface_destroy(tile);
+    thumb->bytes += (thumb->width[0] + FILMSTRIP_GAP) * height * 4;
+    priv->cache_bytes += (thumb->width[0] + FILMSTRIP_GAP) * height * 4;
+  }
+
+  //The frames start at the clip start and move with it. The pattern is
+  //anchored on the last whole frame before the clip area rather than on a
+  //start that may be millions of pixels away
+  span_x = x;
+  span_width = width;
+  gtk_timeline_clip_span(cr, &span_x, &span_width);
+  period = thumb->width[0] + FILMSTRIP_GAP;
+  x += (span_x - x) / period * period;
+  cairo_matrix_init_translate(&matrix, -x, -y);
+  cairo_pattern_set_matrix(thumb->filmstrip, &matrix);
+  cairo_set_source(cr, thumb->filmstrip);
+  cairo_rectangle(cr, span_x, y, span_width, height);
+  cairo_fill(cr);
+}
+
+static void gtk_timeline_draw_audio(GtkWidget *da, cairo_t *cr)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineAudio *audio;
+  gdouble x1, x2;
+  gint x, width, span_x, span_width;
+  guint i, first, last;
+  gint64 start;
+
+  gtk_timeline_get_visible_range(da, cr, &x1, &x2);
+  start = gtk_timeline_x_to_time(priv, x1 - 1);
+  gtk_timeline_clip_store_query(&priv->audio_clips, start, gtk_timeline_x_to_time(priv, x2 + 1), &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->audio_clips, i + 1, start, last))
+  {
+    audio = priv->audio_clips.thumb[i];
+    x = floor(gtk_timeline_time_to_x(priv, priv->audio_clips.start[i]));
+    width = floor(gtk_timeline_time_to_x(priv, priv->audio_clips.start[i] + priv->audio_clips.duration[i])) - x;
+    if (x + width < x1 || x > x2)
+      continue;
+
+    cairo_save(cr);
+    cairo_set_line_width(cr, 1);
+    span_x = x;
+    span_width = width;
+    gtk_timeline_clip_span(cr, &span_x, &span_width);
+    cairo_rectangle(cr, span_x + 0.5, AUDIO_Y + 0.5, span_width - 1, AUDIO_HEIGHT - 1);
+    cairo_set_source_rgb(cr, 0.75, 0.85, 0.75);
+    cairo_fill_preserve(cr);
+    cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+    cairo_stroke(cr);
+    if (audio->peaks)
+    {
+      cairo_rectangle(cr, span_x, AUDIO_Y, span_width, AUDIO_HEIGHT);
+      cairo_clip(cr);
+      gtk_timeline_draw_waveform(priv, cr, audio->peaks, x, MAX(x, floor(x1)), MIN(x + width, ceil(x2)));
+    }
+    cairo_restore(cr);
+  }
+}
+
+//A line per pixel column from its min to its max, read from the level of the
+//pyramid whose entries are about a pixel wide so the cost doesn't depend on
+//the zoom or on how long the clip is
+static void gtk_timeline_draw_waveform(ImgTimelinePrivate *priv, cairo_t *cr, ImgTimelinePeaks *peaks, gint x, gint from, gint to)
+{
+  gdouble frames_per_pixel, middle, scale;
+  gint16 min, max;
+  gint64 first;
+  gint level, px;
+
+  frames_per_pixel = peaks->sample_rate / priv->pixels_per_second;
+  level = gtk_timeline_peaks_get_level(peaks, frames_per_pixel);
+  middle = AUDIO_Y + AUDIO_HEIGHT / 2.0;
+  scale = (AUDIO_HEIGHT / 2.0 - 2) / 32768.0;
+
+  for (px = from; px < to; px++)
+  {
+    first = (px - x) * frames_per_pixel;
+    if (first >= peaks->frames)
+      break;
+    gtk_timeline_peaks_get_range(peaks, level, first, (px - x + 1) * frames_per_pixel, &min, &max);
+    cairo_move_to(cr, px + 0.5, floor(middle - max * scale));
+    cairo_line_to(cr, px + 0.5, floor(middle - min * scale) + 1);
+  }
+  cairo_set_source_rgb(cr, 0.1, 0.35, 0.1);
+  cairo_stroke(cr);
+}
+
+static gint gtk_timeline_slide_at(ImgTimelinePrivate *priv, gdouble x, gdouble y)
+{
+  gint clip_x, width, found = -1;
+  guint i, first, last;
+  gint64 start;
+
+  if (y < SLIDE_Y || y >= SLIDE_Y + SLIDE_HEIGHT)
+    return -1;
+
+  //The slides painted last are on top, the last one hit wins
+  start = gtk_timeline_x_to_time(priv, x - 1);
+  gtk_timeline_clip_store_query(&priv->clips, start, gtk_timeline_x_to_time(priv, x + 1), &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(&priv->clips, i + 1, start, last))
+  {
+    gtk_timeline_get_clip_extents(priv, i, &clip_x, &width);
+    if (x >= clip_x && x < clip_x + width)
+      found = i;
+  }
+  return found;
+}
+
+void gtk_timeline_draw_time_marker(GtkWidget *widget, cairo_t *cr, gint posx)
+{
+  cairo_save(cr);
+  cairo_set_source_rgb(cr, 1,0,0);
+  cairo_translate(cr, posx,17);
+
+  gint i;
+  gint points[3][2] = { 
+                        { 0, 0 }, 
+                        { 5, 15 }, 
+                        { 10, 0 } 
+               
+                      };
+
+  for (i = 0; i < 3; i++)
+    cairo_line_to(cr, points[i][0], points[i][1]);
+
+  cairo_close_path(cr);
+  cairo_stroke_preserve(cr);
+  cairo_fill(cr);
+
+  cairo_move_to(cr, 5,15);
+  cairo_line_to(cr, 5,159);
+  cairo_stroke(cr);
+  cairo_restore(cr);
+}
+
+//Left for the callers still placing the marker by its left edge in pixels
+void img_timeline_adjust_marker_posx(GtkWidget *da, gint posx)
+{
+  gtk_timeline_set_time_marker_x((ImgTimeline*)da, posx);
+}
+
+gboolean gtk_timeline_mouse_button_press (GtkWidget *timeline, GdkEvent *event, gpointer user_data)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)timeline);
+
+  if (event->button.y < SCRUB_Y1 || event->button.y > SCRUB_Y2)
+    return FALSE;
+
+  //The marker follows the pointer until the button is released
+  priv->scrubbing = TRUE;
+  gtk_timeline_scrub_to(timeline, event->button.x + gtk_timeline_get_offset(priv));
+  return TRUE;
+}
+
+//Motion only records where the pointer is, the marker is moved and "scrub"
+//emitted by the frame clock so a 1000 Hz mouse costs no more than a 60 Hz one
+static void gtk_timeline_scrub_to(GtkWidget *da, gdouble x)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  priv->scrub_x = MAX(0, x);
+  priv->scrub_pending = TRUE;
+  gtk_timeline_queue_tick(da);
+}
+
+static void gtk_timeline_queue_tick(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  if (priv->tick == 0)
+    priv->tick = gtk_widget_add_tick_callback(da, gtk_timeline_tick, NULL, NULL);
+}
+
+static gboolean gtk_timeline_tick(GtkWidget *da, GdkFrameClock *frame_clock, gpointer data)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gboolean busy = FALSE;
+
+  if (priv->scrub_pending)
+  {
+    priv->scrub_pending = FALSE;
+    gtk_timeline_set_time_marker_time((ImgTimeline*)da, gtk_timeline_snap_to_frame(priv, gtk_timeline_x_to_time(priv, priv->scrub_x)));
+    g_signal_emit(da, timeline_signals[SCRUB], 0, priv->time_marker);
+    busy = TRUE;
+  }
+  if (priv->drag_pending)
+  {
+    gtk_timeline_drag_update(da);
+    busy = TRUE;
+  }
+
+  //Nothing moved during the last frame, the clock can go idle
+  if (busy || priv->scrubbing || priv->drag_clip >= 0)
+    return G_SOURCE_CONTINUE;
+
+  priv->tick = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean gtk_timeline_button_press_event(GtkWidget *da, GdkEventButton *event)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineClipStore *clips = &priv->clips;
+  gdouble x = event->x + gtk_timeline_get_offset(priv);
+  gint index;
+  guint i;
+
+  if (event->button != GDK_BUTTON_PRIMARY || event->type != GDK_BUTTON_PRESS)
+    return FALSE;
+
+  if (gtk_timeline_mouse_button_press(da, (GdkEvent*)event, NULL))
+    return TRUE;
+
+  index = gtk_timeline_slide_at(priv, x, event->y);
+  if (index < 0)
+    return FALSE;
+
+  //Pressing a selected clip drags the whole selection, any other just itself.
+  //The mark doesn't show until the pointer moves so the store isn't dirtied
+  priv->drag_start = G_MAXINT64;
+  priv->drag_end = G_MININT64;
+  for (i = 0; i < clips->len; i++)
+  {
+    if (i == (guint)index || (clips->flags[index] & clips->flags[i] & CLIP_SELECTED))
+    {
+      clips->flags[i] |= CLIP_DRAGGED;
+      priv->drag_start = MIN(priv->drag_start, clips->start[i]);
+      priv->drag_end = MAX(priv->drag_end, clips->start[i] + clips->duration[i]);
+    }
+  }
+  priv->drag_clip = index;
+  priv->drag_x = x;
+  priv->drag_pointer_x = x;
+  priv->drag_delta = 0;
+  priv->drag_moved = FALSE;
+
+  return TRUE;
+}
+
+static gboolean gtk_timeline_button_release_event(GtkWidget *da, GdkEventButton *event)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  ImgTimelineClipStore *clips = &priv->clips;
+  gdouble x = event->x + gtk_timeline_get_offset(priv);
+  gint index = priv->drag_clip;
+  guint i;
+
+  //The last position is still applied by the next tick
+  if (priv->scrubbing)
+  {
+    priv->scrubbing = FALSE;
+    gtk_timeline_scrub_to(da, x);
+    return TRUE;
+  }
+
+  if (index < 0)
+    return FALSE;
+
+  //The dragged clips are moved in the store only once, on the drop
+  priv->drag_pointer_x = x;
+  gtk_timeline_drag_update(da);
+  if (priv->drag_moved)
+    gtk_timeline_clip_store_offset(clips, CLIP_DRAGGED, priv->drag_delta);
+  else
+  {
+    //A click without a move toggles the selection of the slide
+    gtk_timeline_clip_store_set_flags(clips, index, clips->flags[index] ^ CLIP_SELECTED);
+  }
+  for (i = 0; i < clips->len; i++)
+    clips->flags[i] &= ~CLIP_DRAGGED;
+  priv->drag_delta = 0;
+  priv->drag_clip = -1;
+
+  gtk_timeline_clips_changed((ImgTimeline*)da);
+  gtk_timeline_set_cursor(da, CURSOR_DEFAULT);
+
+  return TRUE;
+}
+
+static gboolean gtk_timeline_motion_notify_event(GtkWidget *da, GdkEventMotion *event)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gdouble pointer_x = event->x + gtk_timeline_get_offset(priv);
+  gint index, x, width;
+
+  if (priv->scrubbing)
+  {
+    gtk_timeline_scrub_to(da, pointer_x);
+    return TRUE;
+  }
+
+  if (priv->drag_clip >= 0)
+  {
+    priv->drag_pointer_x = pointer_x;
+    priv->drag_pending = TRUE;
+    gtk_timeline_queue_tick(da);
+    return TRUE;
+  }
+
+  //Is the pointer on the right edge of a slide?
+  index = gtk_timeline_slide_at(priv, pointer_x, event->y);
+  if (index >= 0)
+  {
+    gtk_timeline_get_clip_extents(priv, index, &x, &width);
+    gtk_timeline_set_cursor(da, pointer_x >= x + width - SLIDE_EDGE ? CURSOR_EDGE : CURSOR_DEFAULT);
+  }
+  else
+    gtk_timeline_set_cursor(da, CURSOR_DEFAULT);
+
+  return FALSE;
+}
+
+//One offset for all the dragged clips, however many they are
+static void gtk_timeline_drag_update(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gint64 delta;
+
+  priv->drag_pending = FALSE;
+  delta = gtk_timeline_x_to_time(priv, priv->drag_pointer_x) - gtk_timeline_x_to_time(priv, priv->drag_x);
+  delta = MAX(delta, -priv->drag_start);
+  if (delta == priv->drag_delta)
+    return;
+
+  gtk_timeline_queue_draw_drag(da);
+  priv->drag_delta = delta;
+  priv->drag_moved = TRUE;
+  gtk_timeline_queue_draw_drag(da);
+  gtk_timeline_set_cursor(da, CURSOR_DRAG);
+}
+
+static void gtk_timeline_queue_draw_drag(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  gtk_timeline_queue_draw_span(da, floor(gtk_timeline_time_to_x(priv, priv->drag_start + priv->drag_delta)),
+                               floor(gtk_timeline_time_to_x(priv, priv->drag_end + priv->drag_delta)) + 1, SLIDE_Y, SLIDE_HEIGHT);
+}
+
+static gboolean gtk_timeline_leave_notify_event(GtkWidget *da, GdkEventCrossing *event)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+
+  if (priv->drag_clip < 0)
+    gtk_timeline_set_cursor(da, CURSOR_DEFAULT);
+  return FALSE;
+}
+
+static void gtk_timeline_realize(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  GdkDisplay *display;
+
+  GTK_WIDGET_CLASS(gtk_timeline_parent_class)->realize(da);
+
+  display = gtk_widget_get_display(da);
+  priv->cursors[CURSOR_DEFAULT] = NULL;
+  priv->cursors[CURSOR_EDGE] = gdk_cursor_new_for_display(display, GDK_RIGHT_SIDE);
+  priv->cursors[CURSOR_DRAG] = gdk_cursor_new_for_display(display, GDK_FLEUR);
+  priv->cursor = CURSOR_DEFAULT;
+}
+
+static void gtk_timeline_unrealize(GtkWidget *da)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  gint i;
+
+  for (i = 0; i < CURSOR_N; i++)
+    g_clear_object(&priv->cursors[i]);
+  if (priv->tick)
+  {
+    gtk_widget_remove_tick_callback(da, priv->tick);
+    priv->tick = 0;
+  }
+
+  GTK_WIDGET_CLASS(gtk_timeline_parent_class)->unrealize(da);
+}
+
+static void gtk_timeline_set_cursor(GtkWidget *da, gint cursor)
+{
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)da);
+  GdkWindow *window;
+
+  window = gtk_widget_get_window(da);
+  if (window == NULL || priv->cursor == cursor)
+    return;
+
+  priv->cursor = cursor;
+  gdk_window_set_cursor(window, priv->cursors[cursor]);
+}
+
+//The last argument is unused, the timeline scrolls its own hadjustment
+gboolean gtk_timeline_scroll(GtkWidget *timeline, GdkEventScroll *event, GtkWidget *scrolledwindow)
+{
+  GdkModifierType accel_mask = gtk_accelerator_get_default_mod_mask();
+  GtkAdjustment *scrollX     = gtk_scrollable_get_hadjustment(GTK_SCROLLABLE(timeline));
+  gdouble deltax, deltay = 0;
+  GdkScrollDirection direction;
+
+  if (gdk_event_get_scroll_direction((GdkEvent*)event, &direction))
+  {
+    if ( direction == GDK_SCROLL_DOWN )
+      deltay = 1;
+
+    if ( direction == GDK_SCROLL_UP )
+      deltay = -1;
   }
+  else
+    gdk_event_get_scroll_deltas((GdkEvent *)event, &deltax, &deltay);
+
+  //Ctrl + wheel zooms around the pointer, smooth scrolling zooms smoothly
+  if ( (event->state & accel_mask) == GDK_CONTROL_MASK)
+    gtk_timeline_zoom_at((ImgTimeline*)timeline, pow(ZOOM_STEP, -deltay), event->x);
+  else if (deltay != 0)
+    gtk_adjustment_set_value(scrollX, gtk_adjustment_get_value(scrollX) + 40 * deltay);
+
   return TRUE;
 }
 
 void gtk_timeline_drag_data_received (GtkWidget *timeline, GdkDragContext *context, gint x, gint y, GtkSelectionData *selection_data, guint info, guint time, gpointer pointer)
 {
+  ImgTimelinePrivate *priv = gtk_timeline_get_instance_private((ImgTimeline*)timeline);
+  GPtrArray *slides;
   gchar **images = NULL;
-  gchar *filename;
+  gchar *filename, *content_type, *mime_type;
+  gint64 audio_start, duration;
+  guint index;
   gint i = 0;
 
   images = gtk_selection_data_get_uris(selection_data);
   if (images)
   {
-    while(images[i])
+    //A drop is always where the pointer is, the left edge too
+    x += gtk_timeline_get_offset(priv);
+    audio_start = MAX(0, gtk_timeline_x_to_time(priv, x));
+    //One redraw and one "changed" for the whole drop, the slides go back to
+    //back from the pointer in a single insertion, the soundtracks one after
+    //the other
+    gtk_timeline_begin_update((ImgTimeline*)timeline);
+    slides = g_ptr_array_new_with_free_func(g_free);
+    for (i = 0; images[i]; i++)
     {
+      //Not a local file, nothing to load it from
       filename = g_filename_from_uri (images[i], NULL, NULL);
-      gtk_timeline_add_slide(timeline, filename, x);
-      g_free(filename);
-      i++;
+      if (filename == NULL)
+        continue;
+      content_type = g_content_type_guess(filename, NULL, 0, NULL);
+      mime_type = g_content_type_get_mime_type(content_type);
+      if (mime_type && g_str_has_prefix(mime_type, "audio/"))
+      {
+        index = gtk_timeline_insert_audio_clip((ImgTimeline*)timeline, filename, audio_start);
+        if (index != G_MAXUINT)
+        {
+          gtk_timeline_get_audio_clip((ImgTimeline*)timeline, index, NULL, &duration);
+          audio_start += duration;
+        }
+        g_free(filename);
+      }
+      else
+        g_ptr_array_add(slides, filename);
+      g_free(mime_type);
+      g_free(content_type);
     }
+    g_ptr_array_add(slides, NULL);
+    gtk_timeline_add_slides((ImgTimeline*)timeline, (gchar**)slides->pdata, MAX(0, gtk_timeline_x_to_time(priv, x) - SLIDE_DURATION / 2));
+    g_ptr_array_free(slides, TRUE);
+    gtk_timeline_end_update((ImgTimeline*)timeline);
   }
   g_strfreev (images);
 
@@ -33,7 +33,7 @@ G_BEGIN_DECLS
 struct _ImgTimeline
 {
   /*< private >*/
-  GtkLayout da;
+  GtkDrawingArea da;
 };
 
 enum
@@ -43,12 +43,99 @@ enum
   VIDEO_BACKGROUND,
   AUDIO_BACKGROUND,
   TOTAL_TIME,
-  TIME_MARKER_POS
+  //Deprecated, the left edge of the marker in pixels, see TIME_MARKER
+  TIME_MARKER_POS,
+  DECODE_THREADS,
+  DEBUG_DAMAGE,
+  PIXELS_PER_SECOND,
+  CACHE_BUDGET,
+  STATS,
+  STATS_OVERLAY,
+  //GtkScrollable
+  HADJUSTMENT,
+  VADJUSTMENT,
+  HSCROLL_POLICY,
+  VSCROLL_POLICY,
+  //Times in microseconds
+  DURATION,
+  TIME_MARKER,
+  FRAME_RATE_NUM,
+  FRAME_RATE_DEN
 };
 
+/**
+ * ImgTimelineCacheStats:
+ *
+ * What the thumbnail cache did so far. A hit is a clip drawn with its
+ * thumbnail at hand, a miss one whose thumbnail had to be decoded.
+ *
+ */
+typedef struct _ImgTimelineCacheStats ImgTimelineCacheStats;
+
+struct _ImgTimelineCacheStats
+{
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+  guint64 bytes;
+  guint64 budget;
+  guint resident;
+};
+
+//The phases of a frame timed by the stats. The ruler and the track
+//backgrounds come together from the tile cache, frame is the whole draw
+typedef enum
+{
+  GTK_TIMELINE_PHASE_TILES,
+  GTK_TIMELINE_PHASE_SLIDES,
+  GTK_TIMELINE_PHASE_AUDIO,
+  GTK_TIMELINE_PHASE_MARKER,
+  GTK_TIMELINE_PHASE_FRAME,
+  GTK_TIMELINE_N_PHASES
+} ImgTimelinePhase;
+
+//Bucket 0 counts the zeros, bucket i the values from 2^(i-1) to 2^i - 1
+#define GTK_TIMELINE_HISTOGRAM_BUCKETS 32
+
+typedef struct _ImgTimelineHistogram ImgTimelineHistogram;
+
+struct _ImgTimelineHistogram
+{
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+  guint64 buckets[GTK_TIMELINE_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * ImgTimelineStats:
+ *
+ * Collected while the stats property is set. The draw phases and the
+ * decode latency, from the request of a thumbnail or peaks to their
+ * arrival on the main loop, are in microseconds. decode_queue is how many
+ * jobs were waiting for a worker whenever one was queued. tile_render is
+ * the time a worker spent drawing each tile, the tiles phase only paints
+ * the finished ones.
+ *
+ */
+typedef struct _ImgTimelineStats ImgTimelineStats;
+
+struct _ImgTimelineStats
+{
+  ImgTimelineHistogram draw[GTK_TIMELINE_N_PHASES];
+  ImgTimelineHistogram decode_latency;
+  ImgTimelineHistogram decode_queue;
+  ImgTimelineHistogram tile_render;
+  ImgTimelineCacheStats cache;
+};
+
+//Receives the strips of gtk_timeline_render_strips() from left to right, x is
+//where strip starts in the whole image. Return FALSE and set error to stop
+typedef gboolean (*ImgTimelineStripFunc) (cairo_surface_t *strip, gint x, gpointer user_data, GError **error);
+
 #define GTK_TIMELINE_TYPE gtk_timeline_get_type()
 
-G_DECLARE_FINAL_TYPE(ImgTimeline, gtk_timeline, GTK, TIMELINE, GtkLayout)
+G_DECLARE_FINAL_TYPE(ImgTimeline, gtk_timeline, GTK, TIMELINE, GtkDrawingArea)
 
 //Public functions.
 GtkWidget* gtk_timeline_new();
@@ -56,21 +143,83 @@ GtkWidget* gtk_timeline_new();
 //Set and get colors.
 void gtk_timeline_set_video_background	(ImgTimeline *da, const gchar *background_string);
 void gtk_timeline_set_audio_background	(ImgTimeline *da, const gchar *background_string);
+
+//Zoom and scroll. The zoom is in pixels per second, zoom_at scales it by
+//factor keeping the time under x, in widget pixels, where it is
+void gtk_timeline_set_pixels_per_second	(ImgTimeline *da, gdouble pixels_per_second);
+void gtk_timeline_zoom_at				(ImgTimeline *da, gdouble factor, gdouble x);
+//One wheel notch in or out from the left edge, zoom is ignored
+G_DEPRECATED_FOR(gtk_timeline_zoom_at)
 void gtk_timeline_adjust_zoom			(GtkWidget *da, gint zoom, gint direction);
+//The time at the left edge of the widget, in microseconds
+void gtk_timeline_scroll_to_time		(ImgTimeline *da, gint64 time);
+gint64 gtk_timeline_get_scroll_time		(ImgTimeline *da);
 void img_timeline_adjust_marker_posx	(GtkWidget *da, gint posx);
+//In whole seconds, the duration in microseconds
 void gtk_timeline_set_total_time		(ImgTimeline *da, gint total_time);
+void gtk_timeline_set_duration			(ImgTimeline *da, gint64 duration);
+gint64 gtk_timeline_get_duration		(ImgTimeline *da);
 void gtk_timeline_add_slide				(GtkWidget *da, gchar *filename, gint posx);
+void gtk_timeline_add_audio				(GtkWidget *da, gchar *filename, gint posx);
 void gtk_timeline_draw_time_marker(GtkWidget *widget, cairo_t *cr, gint pos_X);
+//Places the left edge of the marker at pos_X pixels of the current zoom
+G_DEPRECATED_FOR(gtk_timeline_set_time_marker_time)
 void gtk_timeline_set_time_marker(ImgTimeline *widget, gint pos_X);
+//The marker is on a time in microseconds, scrubbing puts it on the start of a frame
+void gtk_timeline_set_time_marker_time	(ImgTimeline *da, gint64 time);
+gint64 gtk_timeline_get_time_marker_time	(ImgTimeline *da);
+//The ruler and the timecodes count frame_rate_num / frame_rate_den frames per
+//second, 25 by default. Timecodes are non drop frame at the rounded rate
+void gtk_timeline_set_frame_rate		(ImgTimeline *da, gint frame_rate_num, gint frame_rate_den);
+gint64 gtk_timeline_time_to_frame		(ImgTimeline *da, gint64 time);
+gint64 gtk_timeline_frame_to_time		(ImgTimeline *da, gint64 frame);
+//hh:mm:ss:ff of the frame time is in, free it with g_free()
+gchar *gtk_timeline_format_timecode		(ImgTimeline *da, gint64 time);
+void gtk_timeline_set_decode_threads	(ImgTimeline *da, gint decode_threads);
+void gtk_timeline_set_debug_damage		(ImgTimeline *da, gboolean debug_damage);
+void gtk_timeline_set_cache_budget		(ImgTimeline *da, guint64 cache_budget);
+void gtk_timeline_get_cache_stats		(ImgTimeline *da, ImgTimelineCacheStats *stats);
+void gtk_timeline_set_stats				(ImgTimeline *da, gboolean stats);
+void gtk_timeline_set_stats_overlay		(ImgTimeline *da, gboolean stats_overlay);
+void gtk_timeline_get_stats				(ImgTimeline *da, ImgTimelineStats *stats);
+void gtk_timeline_reset_stats			(ImgTimeline *da);
+//The upper bound of the bucket holding the p quantile, 0 <= p <= 1
+guint64 gtk_timeline_histogram_percentile	(const ImgTimelineHistogram *histogram, gdouble p);
+
+//Clips, times are in microseconds. The indexes follow the start of the clips
+//and change when a clip is inserted, removed or moved.
+guint gtk_timeline_insert_clip			(ImgTimeline *da, const gchar *filename, gint64 start, gint64 duration);
+//Slides back to back from start, or after the last one when start is
+//negative, in one insertion. Returns the index of the first one
+guint gtk_timeline_add_slides			(ImgTimeline *da, gchar **filenames, gint64 start);
+void  gtk_timeline_remove_clip			(ImgTimeline *da, guint index);
+guint gtk_timeline_move_clip			(ImgTimeline *da, guint index, gint64 start);
+guint gtk_timeline_get_n_clips			(ImgTimeline *da);
+void  gtk_timeline_get_clip				(ImgTimeline *da, guint index, gint64 *start, gint64 *duration);
+const gchar *gtk_timeline_get_clip_filename	(ImgTimeline *da, guint index);
+//Audio clips, 16 bit PCM WAV files. Their duration is the file's, the
+//insert returns G_MAXUINT when the file can't be read
+guint gtk_timeline_insert_audio_clip	(ImgTimeline *da, const gchar *filename, gint64 start);
+//Trusts duration and reads nothing, the file is only opened by the workers.
+//A clip whose file can't be read stays as a placeholder, like a slide
+guint gtk_timeline_insert_audio_clip_full	(ImgTimeline *da, const gchar *filename, gint64 start, gint64 duration);
+void  gtk_timeline_remove_audio_clip	(ImgTimeline *da, guint index);
+guint gtk_timeline_get_n_audio_clips	(ImgTimeline *da);
+void  gtk_timeline_get_audio_clip		(ImgTimeline *da, guint index, gint64 *start, gint64 *duration);
+const gchar *gtk_timeline_get_audio_clip_filename	(ImgTimeline *da, guint index);
+void  gtk_timeline_begin_update			(ImgTimeline *da);
+void  gtk_timeline_end_update			(ImgTimeline *da);
+
+//Draws start to end at pixels_per_second like the widget draws itself, one
+//strip of strip_width pixels at a time so that the memory doesn't grow with
+//the length. The widget doesn't have to be shown, the thumbnails and peaks
+//not decoded yet are read right away
+gboolean gtk_timeline_render_strips		(ImgTimeline *da, gint64 start, gint64 end, gdouble pixels_per_second, gint strip_width,
+										 ImgTimelineStripFunc func, gpointer user_data, GCancellable *cancellable, GError **error);
 
 gboolean gtk_timeline_scroll( GtkWidget *widget, GdkEventScroll *event, GtkWidget * );
 void gtk_timeline_drag_data_received (GtkWidget *timeline, GdkDragContext *context, gint x, gint y, GtkSelectionData *data, guint info, guint time, gpointer pointer);
-//gboolean gtk_timeline_motion_notify(GtkWidget *timeline, GdkEventMotion *event, gpointer data);
 gboolean gtk_timeline_mouse_button_press (GtkWidget *timeline, GdkEvent *event, gpointer user_data);
-gboolean gtk_timeline_slide_button_press_event (GtkWidget *button, GdkEventButton *event, ImgTimeline *da);
-gboolean gtk_timeline_slide_button_release_event (GtkWidget *button, GdkEventButton *event, ImgTimeline *da);
-gboolean gtk_timeline_slide_motion(GtkWidget *widget, GdkEventCrossing *event, ImgTimeline *da);
-GtkWidget *gtk_timeline_private_get_slide_selected(ImgTimeline *da);
 
 G_END_DECLS
 
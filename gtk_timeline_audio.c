@@ -0,0 +1,507 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+#include "gtk_timeline_audio.h"
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+//How many samples are read from the file at once, as many whole blocks of
+//frames as fit, 256 blocks of a stereo file
+#define READ_SAMPLES (PEAK_BLOCK * 256 * 2)
+
+//More than any real soundtrack has, the header is whatever the file says
+#define MAX_CHANNELS 64
+
+//A peak file is a header of little endian fields:
+//  0 magic, 8 version, 12 PEAK_BLOCK, 16 size and 24 mtime of the audio file,
+//  32 sample rate, 36 channels, 40 frames, 48 levels, 52 unused
+//followed by the min then the max entries of every level, from level 0,
+//as little endian gint16. The length of the levels follows from the frames.
+#define PEAK_FILE_MAGIC   "IMGPEAKS"
+#define PEAK_FILE_VERSION 1
+#define PEAK_FILE_HEADER  56
+
+typedef void (*ImgPeaksKernel) (const gint16 *samples, gsize n, gint16 *min, gint16 *max);
+
+static gboolean gtk_timeline_audio_read_header(FILE *file, gint *sample_rate, gint *channels, gint64 *frames);
+static void gtk_timeline_peaks_init_levels(ImgTimelinePeaks *peaks);
+static gchar *gtk_timeline_peaks_get_path(const gchar *filename, GStatBuf *st);
+static gboolean gtk_timeline_peaks_map_levels(ImgTimelinePeaks *peaks, const gchar *data, gsize size, GStatBuf *st);
+static void gtk_timeline_peaks_put(guchar *p, guint64 value, gint bytes);
+static guint64 gtk_timeline_peaks_get(const guchar *p, gint bytes);
+static void gtk_timeline_peaks_minmax_scalar(const gint16 *samples, gsize n, gint16 *min, gint16 *max);
+#ifdef HAVE_X86_KERNELS
+static void gtk_timeline_peaks_minmax_sse2(const gint16 *samples, gsize n, gint16 *min, gint16 *max);
+static void gtk_timeline_peaks_minmax_avx2(const gint16 *samples, gsize n, gint16 *min, gint16 *max);
+#endif
+
+gboolean gtk_timeline_audio_probe(const gchar *filename, gint *sample_rate, gint *channels, gint64 *frames)
+{
+  FILE *file;
+  gboolean ok;
+
+  file = g_fopen(filename, "rb");
+  if (file == NULL)
+    return FALSE;
+
+  ok = gtk_timeline_audio_read_header(file, sample_rate, channels, frames);
+  fclose(file);
+  return ok;
+}
+
+ImgTimelinePeaks *gtk_timeline_peaks_from_wav(const gchar *filename, GCancellable *cancellable)
+{
+  ImgTimelinePeaks *peaks;
+  FILE *file;
+  gint16 *buffer;
+  gint64 done = 0, entry = 0, len, i, a, b;
+  gsize want, got, block, read_frames;
+  gint l;
+
+  file = g_fopen(filename, "rb");
+  if (file == NULL)
+    return NULL;
+
+  peaks = g_new0(ImgTimelinePeaks, 1);
+  if ( ! gtk_timeline_audio_read_header(file, &peaks->sample_rate, &peaks->channels, &peaks->frames))
+  {
+    fclose(file);
+    g_free(peaks);
+    return NULL;
+  }
+
+  //A truncated file is silent after its end
+  gtk_timeline_peaks_init_levels(peaks);
+  len = peaks->len[0];
+  peaks->min[0] = g_new0(gint16, len);
+  peaks->max[0] = g_new0(gint16, len);
+
+  //The samples go through the kernel a file buffer at a time, only the peaks are kept
+  read_frames = (gsize)MAX(1, READ_SAMPLES / (PEAK_BLOCK * peaks->channels)) * PEAK_BLOCK;
+  buffer = g_new(gint16, read_frames * peaks->channels);
+  while (done < peaks->frames)
+  {
+    if (g_cancellable_is_cancelled(cancellable))
+    {
+      g_free(buffer);
+      fclose(file);
+      gtk_timeline_peaks_free(peaks);
+      return NULL;
+    }
+    want = MIN(peaks->frames - done, (gint64)read_frames);
+    got = fread(buffer, sizeof(gint16) * peaks->channels, want, file);
+    if (got == 0)
+      break;
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+    for (i = 0; i < (gint64)(got * peaks->channels); i++)
+      buffer[i] = GINT16_FROM_LE(buffer[i]);
+#endif
+    for (block = 0; block < got && entry < len; block += PEAK_BLOCK, entry++)
+      gtk_timeline_peaks_minmax(buffer + block * peaks->channels, MIN(PEAK_BLOCK, got - block) * peaks->channels,
+                                &peaks->min[0][entry], &peaks->max[0][entry]);
+    done += got;
+  }
+  g_free(buffer);
+  fclose(file);
+
+  for (l = 1; l < peaks->n_levels; l++)
+  {
+    len = peaks->len[l];
+    peaks->min[l] = g_new(gint16, len);
+    peaks->max[l] = g_new(gint16, len);
+    for (i = 0; i < len; i++)
+    {
+      a = 2 * i;
+      b = MIN(a + 1, peaks->len[l - 1] - 1);
+      peaks->min[l][i] = MIN(peaks->min[l - 1][a], peaks->min[l - 1][b]);
+      peaks->max[l][i] = MAX(peaks->max[l - 1][a], peaks->max[l - 1][b]);
+    }
+  }
+
+  return peaks;
+}
+
+void gtk_timeline_peaks_free(ImgTimelinePeaks *peaks)
+{
+  gint l;
+
+  if (peaks == NULL)
+    return;
+
+  if (peaks->mapped)
+    g_mapped_file_unref(peaks->mapped);
+  else
+    for (l = 0; l < PEAK_MAX_LEVELS; l++)
+    {
+      g_free(peaks->min[l]);
+      g_free(peaks->max[l]);
+    }
+  g_free(peaks);
+}
+
+ImgTimelinePeaks *gtk_timeline_peaks_load(const gchar *filename)
+{
+  ImgTimelinePeaks *peaks;
+  GMappedFile *mapped;
+  GStatBuf st;
+  gchar *path;
+
+  //The levels are mapped as they are, only a little endian host can read them
+  if (G_BYTE_ORDER != G_LITTLE_ENDIAN)
+    return NULL;
+
+  path = gtk_timeline_peaks_get_path(filename, &st);
+  if (path == NULL)
+    return NULL;
+  mapped = g_mapped_file_new(path, FALSE, NULL);
+  g_free(path);
+  if (mapped == NULL)
+    return NULL;
+
+  peaks = g_new0(ImgTimelinePeaks, 1);
+  if ( ! gtk_timeline_peaks_map_levels(peaks, g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped), &st))
+  {
+    g_mapped_file_unref(mapped);
+    g_free(peaks);
+    return NULL;
+  }
+  peaks->mapped = mapped;
+
+  return peaks;
+}
+
+gboolean gtk_timeline_peaks_save(ImgTimelinePeaks *peaks, const gchar *filename)
+{
+  guchar header[PEAK_FILE_HEADER];
+  GStatBuf st;
+  FILE *file;
+  gchar *path, *dir, *tmp;
+  gboolean ok;
+  gint l;
+
+  if (G_BYTE_ORDER != G_LITTLE_ENDIAN)
+    return FALSE;
+
+  path = gtk_timeline_peaks_get_path(filename, &st);
+  if (path == NULL)
+    return FALSE;
+
+  memcpy(header, PEAK_FILE_MAGIC, 8);
+  gtk_timeline_peaks_put(header + 8, PEAK_FILE_VERSION, 4);
+  gtk_timeline_peaks_put(header + 12, PEAK_BLOCK, 4);
+  gtk_timeline_peaks_put(header + 16, st.st_size, 8);
+  gtk_timeline_peaks_put(header + 24, st.st_mtime, 8);
+  gtk_timeline_peaks_put(header + 32, peaks->sample_rate, 4);
+  gtk_timeline_peaks_put(header + 36, peaks->channels, 4);
+  gtk_timeline_peaks_put(header + 40, peaks->frames, 8);
+  gtk_timeline_peaks_put(header + 48, peaks->n_levels, 4);
+  gtk_timeline_peaks_put(header + 52, 0, 4);
+
+  dir = g_path_get_dirname(path);
+  g_mkdir_with_parents(dir, 0700);
+
+  //Write aside and rename so that a reader never maps half a file
+  tmp = g_strdup_printf("%s.%p.tmp", path, (gpointer)peaks);
+  file = g_fopen(tmp, "wb");
+  ok = file != NULL && fwrite(header, 1, PEAK_FILE_HEADER, file) == PEAK_FILE_HEADER;
+  for (l = 0; ok && l < peaks->n_levels; l++)
+    ok = fwrite(peaks->min[l], sizeof(gint16), peaks->len[l], file) == (gsize)peaks->len[l]
+      && fwrite(peaks->max[l], sizeof(gint16), peaks->len[l], file) == (gsize)peaks->len[l];
+  if (file != NULL && fclose(file) != 0)
+    ok = FALSE;
+  if (ok)
+    ok = g_rename(tmp, path) == 0;
+  if ( ! ok)
+    g_unlink(tmp);
+
+  g_free(tmp);
+  g_free(dir);
+  g_free(path);
+  return ok;
+}
+
+gint gtk_timeline_peaks_get_level(ImgTimelinePeaks *peaks, gdouble frames_per_pixel)
+{
+  gint level = 0;
+
+  while (level + 1 < peaks->n_levels && ((gint64)PEAK_BLOCK << (level + 1)) <= frames_per_pixel)
+    level++;
+
+  return level;
+}
+
+void gtk_timeline_peaks_get_range(ImgTimelinePeaks *peaks, gint level, gint64 first, gint64 last, gint16 *min, gint16 *max)
+{
+  gint64 block = (gint64)PEAK_BLOCK << level, i, end;
+
+  *min = 0;
+  *max = 0;
+  if (first < 0 || first >= peaks->frames)
+    return;
+
+  //One or two entries per pixel at the level picked for the zoom
+  i = first / block;
+  end = MIN(peaks->len[level], MAX(i + 1, (last + block - 1) / block));
+  *min = peaks->min[level][i];
+  *max = peaks->max[level][i];
+  for (i++; i < end; i++)
+  {
+    *min = MIN(*min, peaks->min[level][i]);
+    *max = MAX(*max, peaks->max[level][i]);
+  }
+}
+
+void gtk_timeline_peaks_minmax(const gint16 *samples, gsize n, gint16 *min, gint16 *max)
+{
+  static ImgPeaksKernel kernel = NULL;
+  static gsize kernel_ready = 0;
+
+  if (g_once_init_enter(&kernel_ready))
+  {
+    kernel = gtk_timeline_peaks_minmax_scalar;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      kernel = gtk_timeline_peaks_minmax_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+      kernel = gtk_timeline_peaks_minmax_sse2;
+#endif
+    g_once_init_leave(&kernel_ready, 1);
+  }
+  kernel(samples, n, min, max);
+}
+
+static void gtk_timeline_peaks_minmax_scalar(const gint16 *samples, gsize n, gint16 *min, gint16 *max)
+{
+  gint16 low = G_MAXINT16, high = G_MININT16;
+  gsize i;
+
+  for (i = 0; i < n; i++)
+  {
+    low = MIN(low, samples[i]);
+    high = MAX(high, samples[i]);
+  }
+  *min = n > 0 ? low : 0;
+  *max = n > 0 ? high : 0;
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static void gtk_timeline_peaks_minmax_sse2(const gint16 *samples, gsize n, gint16 *min, gint16 *max)
+{
+  __m128i low = _mm_set1_epi16(G_MAXINT16), high = _mm_set1_epi16(G_MININT16), v;
+  gint16 lows[8], highs[8], tail_low, tail_high;
+  gsize i;
+  gint j;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    v = _mm_loadu_si128((const __m128i*)(samples + i));
+    low = _mm_min_epi16(low, v);
+    high = _mm_max_epi16(high, v);
+  }
+  _mm_storeu_si128((__m128i*)lows, low);
+  _mm_storeu_si128((__m128i*)highs, high);
+
+  gtk_timeline_peaks_minmax_scalar(samples + i, n - i, &tail_low, &tail_high);
+  if (i == n)
+  {
+    tail_low = G_MAXINT16;
+    tail_high = G_MININT16;
+  }
+  for (j = 0; j < 8; j++)
+  {
+    tail_low = MIN(tail_low, lows[j]);
+    tail_high = MAX(tail_high, highs[j]);
+  }
+  *min = n > 0 ? tail_low : 0;
+  *max = n > 0 ? tail_high : 0;
+}
+
+__attribute__((target("avx2")))
+static void gtk_timeline_peaks_minmax_avx2(const gint16 *samples, gsize n, gint16 *min, gint16 *max)
+{
+  __m256i low = _mm256_set1_epi16(G_MAXINT16), high = _mm256_set1_epi16(G_MININT16), v;
+  __m128i low128, high128;
+  gint16 lows[8], highs[8], tail_low, tail_high;
+  gsize i;
+  gint j;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    v = _mm256_loadu_si256((const __m256i*)(samples + i));
+    low = _mm256_min_epi16(low, v);
+    high = _mm256_max_epi16(high, v);
+  }
+  low128 = _mm_min_epi16(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+  high128 = _mm_max_epi16(_mm256_castsi256_si128(high), _mm256_extracti128_si256(high, 1));
+  _mm_storeu_si128((__m128i*)lows, low128);
+  _mm_storeu_si128((__m128i*)highs, high128);
+
+  gtk_timeline_peaks_minmax_scalar(samples + i, n - i, &tail_low, &tail_high);
+  if (i == n)
+  {
+    tail_low = G_MAXINT16;
+    tail_high = G_MININT16;
+  }
+  for (j = 0; j < 8; j++)
+  {
+    tail_low = MIN(tail_low, lows[j]);
+    tail_high = MAX(tail_high, highs[j]);
+  }
+  *min = n > 0 ? tail_low : 0;
+  *max = n > 0 ? tail_high : 0;
+}
+#endif
+
+//The length of every level follows from the number of frames
+static void gtk_timeline_peaks_init_levels(ImgTimelinePeaks *peaks)
+{
+  gint l;
+
+  peaks->len[0] = MAX(1, (peaks->frames + PEAK_BLOCK - 1) / PEAK_BLOCK);
+  for (l = 1; l < PEAK_MAX_LEVELS && peaks->len[l - 1] > 1; l++)
+    peaks->len[l] = (peaks->len[l - 1] + 1) / 2;
+  peaks->n_levels = l;
+}
+
+//Like the thumbnails, the peak files go in the user cache named after the
+//MD5 of the audio file
+static gchar *gtk_timeline_peaks_get_path(const gchar *filename, GStatBuf *st)
+{
+  gchar *canonical, *md5, *basename, *path;
+
+  canonical = g_canonicalize_filename(filename, NULL);
+  if (g_stat(canonical, st) != 0)
+  {
+    g_free(canonical);
+    return NULL;
+  }
+  md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, canonical, -1);
+  basename = g_strconcat(md5, ".peaks", NULL);
+  path = g_build_filename(g_get_user_cache_dir(), "gtk_timeline", "peaks", basename, NULL);
+  g_free(basename);
+  g_free(md5);
+  g_free(canonical);
+
+  return path;
+}
+
+//Checks the header against the audio file and points the levels in data
+static gboolean gtk_timeline_peaks_map_levels(ImgTimelinePeaks *peaks, const gchar *data, gsize size, GStatBuf *st)
+{
+  const guchar *header = (const guchar*)data;
+  gsize offset = PEAK_FILE_HEADER;
+  gint l;
+
+  if (size < PEAK_FILE_HEADER || memcmp(header, PEAK_FILE_MAGIC, 8) != 0
+      || gtk_timeline_peaks_get(header + 8, 4) != PEAK_FILE_VERSION
+      || gtk_timeline_peaks_get(header + 12, 4) != PEAK_BLOCK
+      || gtk_timeline_peaks_get(header + 16, 8) != (guint64)st->st_size
+      || (gint64)gtk_timeline_peaks_get(header + 24, 8) != (gint64)st->st_mtime)
+    return FALSE;
+
+  peaks->sample_rate = gtk_timeline_peaks_get(header + 32, 4);
+  peaks->channels = gtk_timeline_peaks_get(header + 36, 4);
+  peaks->frames = gtk_timeline_peaks_get(header + 40, 8);
+  if (peaks->sample_rate <= 0 || peaks->channels <= 0 || peaks->channels > MAX_CHANNELS || peaks->frames < 0)
+    return FALSE;
+
+  gtk_timeline_peaks_init_levels(peaks);
+  if (gtk_timeline_peaks_get(header + 48, 4) != (guint64)peaks->n_levels)
+    return FALSE;
+
+  for (l = 0; l < peaks->n_levels; l++)
+  {
+    if ((guint64)peaks->len[l] > (size - offset) / (2 * sizeof(gint16)))
+      return FALSE;
+    peaks->min[l] = (gint16*)(data + offset);
+    offset += peaks->len[l] * sizeof(gint16);
+    peaks->max[l] = (gint16*)(data + offset);
+    offset += peaks->len[l] * sizeof(gint16);
+  }
+
+  return offset == size;
+}
+
+static void gtk_timeline_peaks_put(guchar *p, guint64 value, gint bytes)
+{
+  gint i;
+
+  for (i = 0; i < bytes; i++)
+    p[i] = value >> (8 * i);
+}
+
+static guint64 gtk_timeline_peaks_get(const guchar *p, gint bytes)
+{
+  guint64 value = 0;
+  gint i;
+
+  for (i = bytes - 1; i >= 0; i--)
+    value = value << 8 | p[i];
+  return value;
+}
+
+//Walks the RIFF chunks up to "data", leaving file at the first sample
+static gboolean gtk_timeline_audio_read_header(FILE *file, gint *sample_rate, gint *channels, gint64 *frames)
+{
+  guchar header[12], chunk[8], fmt[16];
+  guint32 size;
+  gint bits = 0, block_align = 0, format = 0;
+
+  *channels = 0;
+  if (fread(header, 1, 12, file) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    return FALSE;
+
+  while (fread(chunk, 1, 8, file) == 8)
+  {
+    size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (guint32)chunk[7] << 24;
+    if (memcmp(chunk, "fmt ", 4) == 0)
+    {
+      if (size < 16 || fread(fmt, 1, 16, file) != 16)
+        return FALSE;
+      format = fmt[0] | fmt[1] << 8;
+      *channels = fmt[2] | fmt[3] << 8;
+      *sample_rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (guint32)fmt[7] << 24;
+      block_align = fmt[12] | fmt[13] << 8;
+      bits = fmt[14] | fmt[15] << 8;
+      size -= 16;
+    }
+    else if (memcmp(chunk, "data", 4) == 0)
+    {
+      //PCM or WAVE_FORMAT_EXTENSIBLE, 16 bit only
+      if ((format != 1 && format != 0xfffe) || bits != 16 || *channels <= 0 || *channels > MAX_CHANNELS
+          || *sample_rate <= 0 || block_align != 2 * *channels)
+        return FALSE;
+      *frames = size / block_align;
+      return TRUE;
+    }
+
+    //Chunks are padded to an even size
+    if (fseek(file, size + (size & 1), SEEK_CUR) != 0)
+      return FALSE;
+  }
+  return FALSE;
+}
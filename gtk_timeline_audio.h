@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+#ifndef __GTK_TIMELINE_AUDIO_H__
+#define __GTK_TIMELINE_AUDIO_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+//Level 0 of the pyramid keeps the min and max of every PEAK_BLOCK frames,
+//every other level the min and max of two entries of the one below
+#define PEAK_BLOCK      256
+#define PEAK_MAX_LEVELS 32
+
+/**
+ * ImgTimelinePeaks:
+ *
+ * The min/max peak pyramid of a 16 bit PCM soundtrack, all the channels
+ * mixed in the same peaks. When mapped is set the levels point in the
+ * mapped peak file.
+ *
+ */
+typedef struct _ImgTimelinePeaks ImgTimelinePeaks;
+
+struct _ImgTimelinePeaks
+{
+  gint sample_rate;
+  gint channels;
+  gint64 frames;
+
+  gint n_levels;
+  gint64 len[PEAK_MAX_LEVELS];
+  gint16 *min[PEAK_MAX_LEVELS];
+  gint16 *max[PEAK_MAX_LEVELS];
+
+  GMappedFile *mapped;
+};
+
+//Only reads the header of a 16 bit PCM WAV file
+gboolean gtk_timeline_audio_probe			(const gchar *filename, gint *sample_rate, gint *channels, gint64 *frames);
+ImgTimelinePeaks *gtk_timeline_peaks_from_wav	(const gchar *filename, GCancellable *cancellable);
+void gtk_timeline_peaks_free				(ImgTimelinePeaks *peaks);
+
+//The peak file of filename in the user cache. It's only loaded if it was
+//saved for the same size and mtime of filename
+ImgTimelinePeaks *gtk_timeline_peaks_load	(const gchar *filename);
+gboolean gtk_timeline_peaks_save			(ImgTimelinePeaks *peaks, const gchar *filename);
+
+//The level whose entries are the closest to, without being wider than,
+//frames_per_pixel, and the peaks of frames first to last - 1 read from it
+gint gtk_timeline_peaks_get_level			(ImgTimelinePeaks *peaks, gdouble frames_per_pixel);
+void gtk_timeline_peaks_get_range			(ImgTimelinePeaks *peaks, gint level, gint64 first, gint64 last, gint16 *min, gint16 *max);
+
+//Min and max of n samples, with the fastest kernel the CPU has
+void gtk_timeline_peaks_minmax				(const gint16 *samples, gsize n, gint16 *min, gint16 *max);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+#include "gtk_timeline_clips.h"
+#include <string.h>
+
+static void gtk_timeline_clip_store_reserve(ImgTimelineClipStore *store, guint len);
+static void gtk_timeline_clip_store_shift(ImgTimelineClipStore *store, guint to, guint from, guint count);
+static void gtk_timeline_clip_store_copy(ImgTimelineClipStore *dest, guint to, ImgTimelineClipStore *src, guint from);
+static void gtk_timeline_clip_store_dirty(ImgTimelineClipStore *store, gint64 start, gint64 end);
+static void gtk_timeline_clip_store_update_max_end(ImgTimelineClipStore *store);
+
+void gtk_timeline_clip_store_init(ImgTimelineClipStore *store)
+{
+  memset(store, 0, sizeof(ImgTimelineClipStore));
+  store->dirty_start = G_MAXINT64;
+  store->dirty_end = G_MININT64;
+}
+
+void gtk_timeline_clip_store_clear(ImgTimelineClipStore *store)
+{
+  g_free(store->start);
+  g_free(store->duration);
+  g_free(store->thumb);
+  g_free(store->flags);
+  g_free(store->max_end);
+  gtk_timeline_clip_store_init(store);
+}
+
+guint gtk_timeline_clip_store_insert(ImgTimelineClipStore *store, gint64 start, gint64 duration, gpointer thumb, guint32 flags)
+{
+  guint index;
+
+  gtk_timeline_clip_store_reserve(store, store->len + 1);
+
+  //After the clips starting at the same time, so that appending stays O(1)
+  if (store->len == 0 || store->start[store->len - 1] <= start)
+    index = store->len;
+  else
+    index = gtk_timeline_clip_store_lower_bound(store, start + 1);
+
+  gtk_timeline_clip_store_shift(store, index + 1, index, store->len - index);
+  store->start[index] = start;
+  store->duration[index] = duration;
+  store->thumb[index] = thumb;
+  store->flags[index] = flags;
+  store->len++;
+  store->max_end_valid = MIN(store->max_end_valid, index);
+
+  gtk_timeline_clip_store_dirty(store, start, start + duration);
+  return index;
+}
+
+//n clips of the same duration back to back from start, merged from the end
+//with the clips already there so that the store grows and shifts once.
+//Returns the index of the first one
+guint gtk_timeline_clip_store_insert_run(ImgTimelineClipStore *store, gint64 start, gint64 duration, gpointer *thumbs, guint n, guint32 flags)
+{
+  guint a, b, to;
+
+  if (n == 0)
+    return gtk_timeline_clip_store_lower_bound(store, start + 1);
+
+  gtk_timeline_clip_store_reserve(store, store->len + n);
+
+  a = store->len;
+  b = n;
+  to = store->len + n;
+  while (b > 0)
+  {
+    to--;
+    if (a > 0 && store->start[a - 1] > start + (b - 1) * duration)
+      gtk_timeline_clip_store_copy(store, to, store, --a);
+    else
+    {
+      b--;
+      store->start[to] = start + b * duration;
+      store->duration[to] = duration;
+      store->thumb[to] = thumbs[b];
+      store->flags[to] = flags;
+    }
+  }
+  store->len += n;
+  store->max_end_valid = MIN(store->max_end_valid, to);
+
+  gtk_timeline_clip_store_dirty(store, start, start + n * duration);
+  return to;
+}
+
+void gtk_timeline_clip_store_remove(ImgTimelineClipStore *store, guint index)
+{
+  g_return_if_fail(index < store->len);
+
+  gtk_timeline_clip_store_dirty(store, store->start[index], store->start[index] + store->duration[index]);
+  gtk_timeline_clip_store_shift(store, index, index + 1, store->len - index - 1);
+  store->len--;
+  store->max_end_valid = MIN(store->max_end_valid, index);
+}
+
+guint gtk_timeline_clip_store_move(ImgTimelineClipStore *store, guint index, gint64 start)
+{
+  gint64 duration;
+  gpointer thumb;
+  guint32 flags;
+  guint to;
+
+  g_return_val_if_fail(index < store->len, index);
+
+  duration = store->duration[index];
+  thumb = store->thumb[index];
+  flags = store->flags[index];
+  gtk_timeline_clip_store_dirty(store, store->start[index], store->start[index] + duration);
+  gtk_timeline_clip_store_dirty(store, start, start + duration);
+
+  //Only the clips between the old and the new place slide by one
+  to = index;
+  while (to > 0 && store->start[to - 1] > start)
+    to--;
+  while (to + 1 < store->len && store->start[to + 1] <= start)
+    to++;
+
+  if (to < index)
+    gtk_timeline_clip_store_shift(store, to + 1, to, index - to);
+  else if (to > index)
+    gtk_timeline_clip_store_shift(store, index, index + 1, to - index);
+
+  store->start[to] = start;
+  store->duration[to] = duration;
+  store->thumb[to] = thumb;
+  store->flags[to] = flags;
+  store->max_end_valid = MIN(store->max_end_valid, MIN(index, to));
+
+  return to;
+}
+
+void gtk_timeline_clip_store_set_flags(ImgTimelineClipStore *store, guint index, guint32 flags)
+{
+  g_return_if_fail(index < store->len);
+
+  store->flags[index] = flags;
+  gtk_timeline_clip_store_dirty(store, store->start[index], store->start[index] + store->duration[index]);
+}
+
+//Moves all the clips with any of mask set by delta in one pass. They keep
+//their order among themselves so they are pulled out, the others closed up
+//and both merged back from the end
+void gtk_timeline_clip_store_offset(ImgTimelineClipStore *store, guint32 mask, gint64 delta)
+{
+  ImgTimelineClipStore moved;
+  guint i, kept = 0, a, b, to;
+
+  gtk_timeline_clip_store_init(&moved);
+  for (i = 0; i < store->len; i++)
+  {
+    if (store->flags[i] & mask)
+    {
+      gtk_timeline_clip_store_dirty(store, store->start[i], store->start[i] + store->duration[i]);
+      gtk_timeline_clip_store_dirty(store, store->start[i] + delta, store->start[i] + delta + store->duration[i]);
+      gtk_timeline_clip_store_reserve(&moved, moved.len + 1);
+      gtk_timeline_clip_store_copy(&moved, moved.len, store, i);
+      moved.start[moved.len++] += delta;
+    }
+    else
+      gtk_timeline_clip_store_copy(store, kept++, store, i);
+  }
+
+  a = kept;
+  b = moved.len;
+  to = store->len;
+  while (b > 0)
+  {
+    to--;
+    if (a > 0 && store->start[a - 1] > moved.start[b - 1])
+      gtk_timeline_clip_store_copy(store, to, store, --a);
+    else
+      gtk_timeline_clip_store_copy(store, to, &moved, --b);
+  }
+  if (moved.len > 0)
+    store->max_end_valid = 0;
+
+  gtk_timeline_clip_store_clear(&moved);
+}
+
+guint gtk_timeline_clip_store_lower_bound(ImgTimelineClipStore *store, gint64 start)
+{
+  guint low = 0, high = store->len, mid;
+
+  while (low < high)
+  {
+    mid = low + (high - low) / 2;
+    if (store->start[mid] < start)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+//The clips overlapping [start, end) are between first and last - 1: none
+//before first reaches past start and none from last on starts before end.
+//Walk them with gtk_timeline_clip_store_next(), it skips the ones in between
+//that end before start, shadowed by a longer clip
+void gtk_timeline_clip_store_query(ImgTimelineClipStore *store, gint64 start, gint64 end, guint *first, guint *last)
+{
+  *last = gtk_timeline_clip_store_lower_bound(store, end);
+  *first = gtk_timeline_clip_store_next(store, 0, start, *last);
+}
+
+//The first clip from index on that ends after start, or last when there's
+//none before it. Climbs to the first subtree on the right reaching past
+//start, then goes down its leftmost such branch
+guint gtk_timeline_clip_store_next(ImgTimelineClipStore *store, guint index, gint64 start, guint last)
+{
+  guint node;
+
+  if (index >= last)
+    return last;
+  gtk_timeline_clip_store_update_max_end(store);
+
+  node = store->max_end_size + index;
+  while (store->max_end[node] <= start)
+  {
+    //Up while a right child, the root is one so past it node is 0
+    while (node & 1)
+      node >>= 1;
+    if (node == 0)
+      return last;
+    node++;
+  }
+  while (node < store->max_end_size)
+  {
+    node *= 2;
+    if (store->max_end[node] <= start)
+      node++;
+  }
+  return MIN(node - store->max_end_size, last);
+}
+
+//The last clip, the one painted on top, covering time or -1
+gint gtk_timeline_clip_store_find(ImgTimelineClipStore *store, gint64 time)
+{
+  guint i, first, last;
+  gint found = -1;
+
+  gtk_timeline_clip_store_query(store, time, time + 1, &first, &last);
+  for (i = first; i < last; i = gtk_timeline_clip_store_next(store, i + 1, time, last))
+    found = i;
+  return found;
+}
+
+gboolean gtk_timeline_clip_store_take_dirty(ImgTimelineClipStore *store, gint64 *start, gint64 *end)
+{
+  if (store->dirty_start > store->dirty_end)
+    return FALSE;
+
+  *start = store->dirty_start;
+  *end = store->dirty_end;
+  store->dirty_start = G_MAXINT64;
+  store->dirty_end = G_MININT64;
+
+  return TRUE;
+}
+
+static void gtk_timeline_clip_store_reserve(ImgTimelineClipStore *store, guint len)
+{
+  if (len <= store->allocated)
+    return;
+
+  store->allocated = MAX(len, MAX(64, store->allocated * 2));
+  store->start = g_renew(gint64, store->start, store->allocated);
+  store->duration = g_renew(gint64, store->duration, store->allocated);
+  store->thumb = g_renew(gpointer, store->thumb, store->allocated);
+  store->flags = g_renew(guint32, store->flags, store->allocated);
+}
+
+static void gtk_timeline_clip_store_shift(ImgTimelineClipStore *store, guint to, guint from, guint count)
+{
+  if (count == 0)
+    return;
+
+  memmove(store->start + to, store->start + from, count * sizeof(gint64));
+  memmove(store->duration + to, store->duration + from, count * sizeof(gint64));
+  memmove(store->thumb + to, store->thumb + from, count * sizeof(gpointer));
+  memmove(store->flags + to, store->flags + from, count * sizeof(guint32));
+}
+
+static void gtk_timeline_clip_store_copy(ImgTimelineClipStore *dest, guint to, ImgTimelineClipStore *src, guint from)
+{
+  dest->start[to] = src->start[from];
+  dest->duration[to] = src->duration[from];
+  dest->thumb[to] = src->thumb[from];
+  dest->flags[to] = src->flags[from];
+}
+
+static void gtk_timeline_clip_store_dirty(ImgTimelineClipStore *store, gint64 start, gint64 end)
+{
+  store->dirty_start = MIN(store->dirty_start, start);
+  store->dirty_end = MAX(store->dirty_end, end);
+}
+
+//Rewrites the leaves from max_end_valid on, and the leaves of the clips
+//removed since, then their parents level by level
+static void gtk_timeline_clip_store_update_max_end(ImgTimelineClipStore *store)
+{
+  guint size = 1, i, low, high;
+
+  while (size < store->len)
+    size *= 2;
+  if (size != store->max_end_size)
+  {
+    g_free(store->max_end);
+    store->max_end = g_new(gint64, 2 * size);
+    for (i = 0; i < 2 * size; i++)
+      store->max_end[i] = G_MININT64;
+    store->max_end_size = size;
+    store->max_end_valid = 0;
+    store->max_end_len = 0;
+  }
+
+  low = store->max_end_valid;
+  high = MAX(store->len, store->max_end_len);
+  if (low >= high)
+    return;
+
+  for (i = low; i < high; i++)
+    store->max_end[size + i] = i < store->len ? store->start[i] + store->duration[i] : G_MININT64;
+  for (low += size, high += size - 1; low > 1; )
+  {
+    low /= 2;
+    high /= 2;
+    for (i = low; i <= high; i++)
+      store->max_end[i] = MAX(store->max_end[2 * i], store->max_end[2 * i + 1]);
+  }
+  store->max_end_valid = store->len;
+  store->max_end_len = store->len;
+}
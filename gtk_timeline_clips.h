@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+#ifndef __GTK_TIMELINE_CLIPS_H__
+#define __GTK_TIMELINE_CLIPS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ImgTimelineClipStore:
+ *
+ * The clips of a track as a structure of arrays kept sorted by start.
+ * Times are in microseconds. Every mutation grows the dirty range, which
+ * the owner reads and resets when it notifies its listeners.
+ *
+ * max_end is a binary tree over the indexes, max_end_size leaves wide, each
+ * node holding the latest end below it. The clips that reach past a time
+ * are found one after the other in O(log n) each, however long the clips
+ * before them, see gtk_timeline_clip_store_next(). Mutations only lower
+ * max_end_valid, the leaves from there are brought up to date by the next
+ * query.
+ *
+ */
+typedef struct _ImgTimelineClipStore ImgTimelineClipStore;
+
+struct _ImgTimelineClipStore
+{
+  guint len;
+  guint allocated;
+
+  gint64 *start;
+  gint64 *duration;
+  gpointer *thumb;
+  guint32 *flags;
+  gint64 *max_end;
+  guint max_end_size;
+  guint max_end_valid;
+  guint max_end_len;
+
+  gint64 dirty_start;
+  gint64 dirty_end;
+};
+
+void  gtk_timeline_clip_store_init			(ImgTimelineClipStore *store);
+void  gtk_timeline_clip_store_clear			(ImgTimelineClipStore *store);
+guint gtk_timeline_clip_store_insert		(ImgTimelineClipStore *store, gint64 start, gint64 duration, gpointer thumb, guint32 flags);
+guint gtk_timeline_clip_store_insert_run	(ImgTimelineClipStore *store, gint64 start, gint64 duration, gpointer *thumbs, guint n, guint32 flags);
+void  gtk_timeline_clip_store_remove		(ImgTimelineClipStore *store, guint index);
+guint gtk_timeline_clip_store_move			(ImgTimelineClipStore *store, guint index, gint64 start);
+void  gtk_timeline_clip_store_set_flags		(ImgTimelineClipStore *store, guint index, guint32 flags);
+void  gtk_timeline_clip_store_offset		(ImgTimelineClipStore *store, guint32 mask, gint64 delta);
+guint gtk_timeline_clip_store_lower_bound	(ImgTimelineClipStore *store, gint64 start);
+void  gtk_timeline_clip_store_query			(ImgTimelineClipStore *store, gint64 start, gint64 end, guint *first, guint *last);
+guint gtk_timeline_clip_store_next			(ImgTimelineClipStore *store, guint index, gint64 start, guint last);
+gint  gtk_timeline_clip_store_find			(ImgTimelineClipStore *store, gint64 time);
+gboolean gtk_timeline_clip_store_take_dirty	(ImgTimelineClipStore *store, gint64 *start, gint64 *end);
+
+G_END_DECLS
+
+#endif
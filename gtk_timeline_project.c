@@ -0,0 +1,237 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+#include "gtk_timeline_project.h"
+#include <string.h>
+
+#define PROJECT_HEADER "# gtk_timeline project 1"
+
+//The lines are written out in chunks of about this size
+#define PROJECT_CHUNK (64 * 1024)
+
+static gboolean gtk_timeline_project_append(GString *chunk, const gchar *track, gint64 start, gint64 duration, const gchar *filename,
+                                            GOutputStream *stream, GCancellable *cancellable, GError **error);
+static gboolean gtk_timeline_project_parse_line(ImgTimeline *da, gchar *line, GError **error);
+
+gboolean gtk_timeline_project_save(ImgTimeline *da, GOutputStream *stream, GCancellable *cancellable, GError **error)
+{
+  GString *chunk;
+  gint64 start, duration;
+  gboolean ok = TRUE;
+  guint i, n;
+
+  chunk = g_string_sized_new(PROJECT_CHUNK + 1024);
+  g_string_append(chunk, PROJECT_HEADER "\n");
+
+  n = gtk_timeline_get_n_clips(da);
+  for (i = 0; ok && i < n; i++)
+  {
+    gtk_timeline_get_clip(da, i, &start, &duration);
+    ok = gtk_timeline_project_append(chunk, "video", start, duration, gtk_timeline_get_clip_filename(da, i), stream, cancellable, error);
+  }
+  n = gtk_timeline_get_n_audio_clips(da);
+  for (i = 0; ok && i < n; i++)
+  {
+    gtk_timeline_get_audio_clip(da, i, &start, &duration);
+    ok = gtk_timeline_project_append(chunk, "audio", start, duration, gtk_timeline_get_audio_clip_filename(da, i), stream, cancellable, error);
+  }
+  if (ok)
+    ok = g_output_stream_write_all(stream, chunk->str, chunk->len, NULL, cancellable, error);
+
+  g_string_free(chunk, TRUE);
+  return ok;
+}
+
+gboolean gtk_timeline_project_load(ImgTimeline *da, GInputStream *stream, GCancellable *cancellable, GError **error)
+{
+  GDataInputStream *data;
+  GError *read_error = NULL;
+  gchar *line;
+  gboolean ok = TRUE;
+  guint number = 1;
+
+  data = g_data_input_stream_new(stream);
+  g_data_input_stream_set_newline_type(data, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+  g_buffered_input_stream_set_buffer_size(G_BUFFERED_INPUT_STREAM(data), PROJECT_CHUNK);
+
+  line = g_data_input_stream_read_line(data, NULL, cancellable, &read_error);
+  if (line == NULL || strcmp(line, PROJECT_HEADER) != 0)
+  {
+    if (read_error)
+      g_propagate_error(error, read_error);
+    else
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a gtk_timeline project");
+    g_free(line);
+    g_object_unref(data);
+    return FALSE;
+  }
+  g_free(line);
+
+  //Every clip is appended to its track as the lines come, then notified
+  //once. The clips loaded before an error are kept
+  gtk_timeline_begin_update(da);
+  while (gtk_timeline_get_n_clips(da) > 0)
+    gtk_timeline_remove_clip(da, gtk_timeline_get_n_clips(da) - 1);
+  while (gtk_timeline_get_n_audio_clips(da) > 0)
+    gtk_timeline_remove_audio_clip(da, gtk_timeline_get_n_audio_clips(da) - 1);
+
+  while (ok && (line = g_data_input_stream_read_line(data, NULL, cancellable, &read_error)) != NULL)
+  {
+    number++;
+    if (line[0] != '\0' && line[0] != '#' && ! gtk_timeline_project_parse_line(da, line, error))
+    {
+      g_prefix_error(error, "Line %u: ", number);
+      ok = FALSE;
+    }
+    g_free(line);
+  }
+  if (read_error)
+  {
+    g_propagate_error(error, read_error);
+    ok = FALSE;
+  }
+  gtk_timeline_end_update(da);
+
+  g_object_unref(data);
+  return ok;
+}
+
+gboolean gtk_timeline_project_save_to_file(ImgTimeline *da, const gchar *filename, GError **error)
+{
+  GFileOutputStream *stream;
+  GFile *file;
+  gboolean ok;
+
+  //Replaced only once the new project is all written
+  file = g_file_new_for_path(filename);
+  stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  g_object_unref(file);
+  if (stream == NULL)
+    return FALSE;
+
+  ok = gtk_timeline_project_save(da, G_OUTPUT_STREAM(stream), NULL, error);
+  if (ok)
+    ok = g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, error);
+  else
+  {
+    //Cancelling before closing keeps the old file
+    GCancellable *cancellable = g_cancellable_new();
+
+    g_cancellable_cancel(cancellable);
+    g_output_stream_close(G_OUTPUT_STREAM(stream), cancellable, NULL);
+    g_object_unref(cancellable);
+  }
+  g_object_unref(stream);
+
+  return ok;
+}
+
+gboolean gtk_timeline_project_load_from_file(ImgTimeline *da, const gchar *filename, GError **error)
+{
+  GFileInputStream *stream;
+  GFile *file;
+  gboolean ok;
+
+  file = g_file_new_for_path(filename);
+  stream = g_file_read(file, NULL, error);
+  g_object_unref(file);
+  if (stream == NULL)
+    return FALSE;
+
+  ok = gtk_timeline_project_load(da, G_INPUT_STREAM(stream), NULL, error);
+  g_object_unref(stream);
+
+  return ok;
+}
+
+//The filenames are saved as URIs, escaped so that no tab or newline in them
+//can break a line
+static gboolean gtk_timeline_project_append(GString *chunk, const gchar *track, gint64 start, gint64 duration, const gchar *filename,
+                                            GOutputStream *stream, GCancellable *cancellable, GError **error)
+{
+  gchar *canonical, *uri;
+  gboolean ok = TRUE;
+
+  canonical = g_canonicalize_filename(filename, NULL);
+  uri = g_filename_to_uri(canonical, NULL, error);
+  g_free(canonical);
+  if (uri == NULL)
+    return FALSE;
+
+  g_string_append_printf(chunk, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\n", track, start, duration, uri);
+  g_free(uri);
+
+  if (chunk->len >= PROJECT_CHUNK)
+  {
+    ok = g_output_stream_write_all(stream, chunk->str, chunk->len, NULL, cancellable, error);
+    g_string_truncate(chunk, 0);
+  }
+  return ok;
+}
+
+static gboolean gtk_timeline_project_parse_line(ImgTimeline *da, gchar *line, GError **error)
+{
+  gchar *fields[4], *end, *filename;
+  gint64 start, duration;
+  gint i;
+
+  //Split in place, the uri is the rest of the line
+  fields[0] = line;
+  for (i = 1; i < 4; i++)
+  {
+    fields[i] = strchr(fields[i - 1], '\t');
+    if (fields[i] == NULL)
+    {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Expected 4 fields");
+      return FALSE;
+    }
+    *fields[i]++ = '\0';
+  }
+
+  start = g_ascii_strtoll(fields[1], &end, 10);
+  if (end == fields[1] || *end != '\0' || start < 0)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid start \"%s\"", fields[1]);
+    return FALSE;
+  }
+  duration = g_ascii_strtoll(fields[2], &end, 10);
+  if (end == fields[2] || *end != '\0' || duration <= 0)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid duration \"%s\"", fields[2]);
+    return FALSE;
+  }
+  filename = g_filename_from_uri(fields[3], NULL, error);
+  if (filename == NULL)
+    return FALSE;
+
+  //The audio files are only read by the peak workers, a missing one stays
+  //in the project with its saved duration like a missing slide
+  if (strcmp(fields[0], "video") == 0)
+    gtk_timeline_insert_clip(da, filename, start, duration);
+  else if (strcmp(fields[0], "audio") == 0)
+    gtk_timeline_insert_audio_clip_full(da, filename, start, duration);
+  else
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unknown track \"%s\"", fields[0]);
+    g_free(filename);
+    return FALSE;
+  }
+  g_free(filename);
+
+  return TRUE;
+}
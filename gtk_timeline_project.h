@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+#ifndef __GTK_TIMELINE_PROJECT_H__
+#define __GTK_TIMELINE_PROJECT_H__
+
+#include "gtk_timeline.h"
+
+G_BEGIN_DECLS
+
+//A project is a text file read and written a line at a time:
+//
+//  # gtk_timeline project 1
+//  video<TAB>start<TAB>duration<TAB>uri
+//  audio<TAB>start<TAB>duration<TAB>uri
+//
+//with the times in microseconds and the clips of every track sorted by
+//start. Loading replaces the clips of the timeline and decodes nothing, the
+//thumbnails are decoded when their clips are first drawn.
+gboolean gtk_timeline_project_save				(ImgTimeline *da, GOutputStream *stream, GCancellable *cancellable, GError **error);
+gboolean gtk_timeline_project_load				(ImgTimeline *da, GInputStream *stream, GCancellable *cancellable, GError **error);
+gboolean gtk_timeline_project_save_to_file		(ImgTimeline *da, const gchar *filename, GError **error);
+gboolean gtk_timeline_project_load_from_file	(ImgTimeline *da, const gchar *filename, GError **error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,443 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+#include "gtk_timeline_thumbnail.h"
+#include <glib/gstdio.h>
+#include <stdio.h>
+#ifdef HAVE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+//The freedesktop.org "normal" size, thumbnails fit in a 128x128 box
+#define THUMBNAIL_NORMAL_SIZE 128
+
+//The EXIF APP1 segment and the frame header sit in the first bytes of a JPEG
+#define JPEG_HEADER_READ 131072
+
+typedef struct _ImgThumbnailKey ImgThumbnailKey;
+
+struct _ImgThumbnailKey
+{
+  gchar *uri;
+  gchar *path;
+  gchar *mtime;
+  gchar *size;
+};
+
+static gboolean gtk_timeline_thumbnail_key_init(ImgThumbnailKey *key, const gchar *filename);
+static void gtk_timeline_thumbnail_key_clear(ImgThumbnailKey *key);
+static GdkPixbuf *gtk_timeline_thumbnail_scale(GdkPixbuf *pix, gint height);
+static GdkPixbuf *gtk_timeline_thumbnail_fit(GdkPixbuf *pix, gint width, gint height);
+static void gtk_timeline_thumbnail_box(gint width, gint height, gint size, gint *box_width, gint *box_height);
+static GdkPixbuf *gtk_timeline_thumbnail_decode_exif(const gchar *filename, gint size);
+#ifdef HAVE_LIBJPEG
+static GdkPixbuf *gtk_timeline_thumbnail_decode_jpeg(const gchar *filename, gint size);
+#endif
+
+GdkPixbuf *gtk_timeline_thumbnail_load(const gchar *filename, gint height, GCancellable *cancellable)
+{
+  GdkPixbuf *pix, *thumb;
+
+  pix = gtk_timeline_thumbnail_cache_lookup(filename, height);
+  if (pix || g_cancellable_is_cancelled(cancellable))
+    return pix;
+
+  //Decode once at the size of the cache so that the next launches can use it
+  pix = gtk_timeline_thumbnail_decode(filename, THUMBNAIL_NORMAL_SIZE, IMG_THUMBNAIL_DECODE_AUTO);
+  if (pix == NULL)
+    return NULL;
+
+  gtk_timeline_thumbnail_cache_store(filename, pix);
+  thumb = gtk_timeline_thumbnail_scale(pix, height);
+  g_object_unref(pix);
+
+  return thumb;
+}
+
+GdkPixbuf *gtk_timeline_thumbnail_cache_lookup(const gchar *filename, gint height)
+{
+  ImgThumbnailKey key;
+  GdkPixbuf *pix, *thumb = NULL;
+
+  //Only the source file metadata is read, never its pixels
+  if ( ! gtk_timeline_thumbnail_key_init(&key, filename))
+    return NULL;
+
+  pix = gdk_pixbuf_new_from_file(key.path, NULL);
+  if (pix)
+  {
+    if (g_strcmp0(gdk_pixbuf_get_option(pix, "tEXt::Thumb::URI"), key.uri) == 0
+        && g_strcmp0(gdk_pixbuf_get_option(pix, "tEXt::Thumb::MTime"), key.mtime) == 0
+        && g_strcmp0(gdk_pixbuf_get_option(pix, "tEXt::Thumb::Size"), key.size) == 0)
+      thumb = gtk_timeline_thumbnail_scale(pix, height);
+
+    g_object_unref(pix);
+  }
+  gtk_timeline_thumbnail_key_clear(&key);
+
+  return thumb;
+}
+
+void gtk_timeline_thumbnail_cache_store(const gchar *filename, GdkPixbuf *pix)
+{
+  ImgThumbnailKey key;
+  gchar *dir, *tmp;
+
+  if ( ! gtk_timeline_thumbnail_key_init(&key, filename))
+    return;
+
+  dir = g_path_get_dirname(key.path);
+  g_mkdir_with_parents(dir, 0700);
+
+  //Write aside and rename so that a reader never sees half a thumbnail
+  tmp = g_strdup_printf("%s.%p.tmp", key.path, (gpointer)pix);
+  if (gdk_pixbuf_save(pix, tmp, "png", NULL,
+                      "tEXt::Thumb::URI", key.uri,
+                      "tEXt::Thumb::MTime", key.mtime,
+                      "tEXt::Thumb::Size", key.size,
+                      "tEXt::Software", "gtk_timeline",
+                      NULL))
+  {
+    g_chmod(tmp, 0600);
+    if (g_rename(tmp, key.path) != 0)
+      g_unlink(tmp);
+  }
+  else
+    g_unlink(tmp);
+
+  g_free(tmp);
+  g_free(dir);
+  gtk_timeline_thumbnail_key_clear(&key);
+}
+
+static gboolean gtk_timeline_thumbnail_key_init(ImgThumbnailKey *key, const gchar *filename)
+{
+  GStatBuf st;
+  gchar *canonical, *md5, *basename;
+
+  canonical = g_canonicalize_filename(filename, NULL);
+  if (g_stat(canonical, &st) != 0)
+  {
+    g_free(canonical);
+    return FALSE;
+  }
+  key->uri = g_filename_to_uri(canonical, NULL, NULL);
+  g_free(canonical);
+  if (key->uri == NULL)
+    return FALSE;
+
+  md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, key->uri, -1);
+  basename = g_strconcat(md5, ".png", NULL);
+  key->path = g_build_filename(g_get_user_cache_dir(), "thumbnails", "normal", basename, NULL);
+  key->mtime = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)st.st_mtime);
+  key->size = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)st.st_size);
+  g_free(basename);
+  g_free(md5);
+
+  return TRUE;
+}
+
+static void gtk_timeline_thumbnail_key_clear(ImgThumbnailKey *key)
+{
+  g_free(key->uri);
+  g_free(key->path);
+  g_free(key->mtime);
+  g_free(key->size);
+}
+
+static GdkPixbuf *gtk_timeline_thumbnail_scale(GdkPixbuf *pix, gint height)
+{
+  gint width;
+
+  if (gdk_pixbuf_get_height(pix) == height)
+    return g_object_ref(pix);
+
+  width = MAX(1, gdk_pixbuf_get_width(pix) * height / gdk_pixbuf_get_height(pix));
+  return gdk_pixbuf_scale_simple(pix, width, height, GDK_INTERP_BILINEAR);
+}
+
+GdkPixbuf *gtk_timeline_thumbnail_decode(const gchar *filename, gint size, ImgThumbnailDecode method)
+{
+  GdkPixbuf *pix = NULL;
+
+  if (method == IMG_THUMBNAIL_DECODE_AUTO || method == IMG_THUMBNAIL_DECODE_EXIF)
+    pix = gtk_timeline_thumbnail_decode_exif(filename, size);
+
+#ifdef HAVE_LIBJPEG
+  if (pix == NULL && (method == IMG_THUMBNAIL_DECODE_AUTO || method == IMG_THUMBNAIL_DECODE_JPEG_SCALED))
+    pix = gtk_timeline_thumbnail_decode_jpeg(filename, size);
+#endif
+
+  if (pix == NULL && (method == IMG_THUMBNAIL_DECODE_AUTO || method == IMG_THUMBNAIL_DECODE_GDK_PIXBUF))
+    pix = gdk_pixbuf_new_from_file_at_scale(filename, size, size, TRUE, NULL);
+
+  return pix;
+}
+
+static GdkPixbuf *gtk_timeline_thumbnail_fit(GdkPixbuf *pix, gint width, gint height)
+{
+  if (gdk_pixbuf_get_width(pix) == width && gdk_pixbuf_get_height(pix) == height)
+    return g_object_ref(pix);
+
+  return gdk_pixbuf_scale_simple(pix, width, height, GDK_INTERP_BILINEAR);
+}
+
+static void gtk_timeline_thumbnail_box(gint width, gint height, gint size, gint *box_width, gint *box_height)
+{
+  if (width >= height)
+  {
+    *box_width = MIN(width, size);
+    *box_height = MAX(1, (gint64)height * *box_width / width);
+  }
+  else
+  {
+    *box_height = MIN(height, size);
+    *box_width = MAX(1, (gint64)width * *box_height / height);
+  }
+}
+
+static guint gtk_timeline_exif_get16(const guchar *p, gboolean big_endian)
+{
+  return big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static guint32 gtk_timeline_exif_get32(const guchar *p, gboolean big_endian)
+{
+  return big_endian ? ((guint32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                    : ((guint32)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+//Finds the JPEG preview in IFD1 of the TIFF block of an EXIF segment
+static gboolean gtk_timeline_exif_find_thumbnail(const guchar *tiff, gsize len, const guchar **thumb, gsize *thumb_len)
+{
+  gboolean big_endian;
+  guint32 ifd, offset = 0, length = 0;
+  guint i, entries, tag;
+
+  if (len < 8)
+    return FALSE;
+  if (tiff[0] == 'M' && tiff[1] == 'M')
+    big_endian = TRUE;
+  else if (tiff[0] == 'I' && tiff[1] == 'I')
+    big_endian = FALSE;
+  else
+    return FALSE;
+
+  //Skip IFD0 to reach IFD1, the thumbnail one
+  ifd = gtk_timeline_exif_get32(tiff + 4, big_endian);
+  if (ifd < 8 || ifd > len - 2)
+    return FALSE;
+  entries = gtk_timeline_exif_get16(tiff + ifd, big_endian);
+  if (ifd + 2 + entries * 12 + 4 > len)
+    return FALSE;
+  ifd = gtk_timeline_exif_get32(tiff + ifd + 2 + entries * 12, big_endian);
+  if (ifd < 8 || ifd > len - 2)
+    return FALSE;
+
+  entries = gtk_timeline_exif_get16(tiff + ifd, big_endian);
+  if (ifd + 2 + entries * 12 > len)
+    return FALSE;
+  for (i = 0; i < entries; i++)
+  {
+    const guchar *entry = tiff + ifd + 2 + i * 12;
+
+    tag = gtk_timeline_exif_get16(entry, big_endian);
+    if (tag == 0x0201)
+      offset = gtk_timeline_exif_get32(entry + 8, big_endian);
+    else if (tag == 0x0202)
+      length = gtk_timeline_exif_get32(entry + 8, big_endian);
+  }
+  if (offset == 0 || length == 0 || offset > len || length > len - offset)
+    return FALSE;
+
+  *thumb = tiff + offset;
+  *thumb_len = length;
+  return TRUE;
+}
+
+static GdkPixbuf *gtk_timeline_thumbnail_decode_exif(const gchar *filename, gint size)
+{
+  GdkPixbufLoader *loader;
+  GdkPixbuf *preview, *pix = NULL;
+  const guchar *thumb = NULL;
+  guchar *data;
+  gsize len, pos, thumb_len = 0;
+  guint marker, segment;
+  gint width = 0, height = 0, box_width, box_height, preview_width, preview_height;
+  FILE *fp;
+
+  fp = g_fopen(filename, "rb");
+  if (fp == NULL)
+    return NULL;
+  data = g_malloc(JPEG_HEADER_READ);
+  len = fread(data, 1, JPEG_HEADER_READ, fp);
+  fclose(fp);
+
+  if (len < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    goto out;
+
+  //Walk the segments up to the frame header, remembering the EXIF preview
+  pos = 2;
+  while (pos + 4 <= len && data[pos] == 0xFF)
+  {
+    marker = data[pos + 1];
+    segment = (data[pos + 2] << 8) | data[pos + 3];
+    if (segment < 2 || pos + 2 + segment > len)
+      break;
+
+    if (marker == 0xE1 && segment >= 8 && memcmp(data + pos + 4, "Exif\0\0", 6) == 0)
+      gtk_timeline_exif_find_thumbnail(data + pos + 10, segment - 8, &thumb, &thumb_len);
+    else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+    {
+      if (segment >= 7)
+      {
+        height = (data[pos + 5] << 8) | data[pos + 6];
+        width  = (data[pos + 7] << 8) | data[pos + 8];
+      }
+      break;
+    }
+    pos += 2 + segment;
+  }
+  if (thumb == NULL || width == 0 || height == 0)
+    goto out;
+
+  loader = gdk_pixbuf_loader_new_with_type("jpeg", NULL);
+  if (loader == NULL)
+    goto out;
+  if (gdk_pixbuf_loader_write(loader, thumb, thumb_len, NULL) && gdk_pixbuf_loader_close(loader, NULL))
+  {
+    preview = gdk_pixbuf_loader_get_pixbuf(loader);
+    gtk_timeline_thumbnail_box(width, height, size, &box_width, &box_height);
+    preview_width = gdk_pixbuf_get_width(preview);
+    preview_height = gdk_pixbuf_get_height(preview);
+
+    //Cameras often letterbox the preview, only use it when it has the image aspect and is big enough
+    if (preview_width >= box_width && preview_height >= box_height
+        && ABS((gint64)preview_width * height - (gint64)preview_height * width) <= (gint64)width * height / 50)
+      pix = gtk_timeline_thumbnail_fit(preview, box_width, box_height);
+  }
+  else
+    gdk_pixbuf_loader_close(loader, NULL);
+  g_object_unref(loader);
+
+out:
+  g_free(data);
+  return pix;
+}
+
+#ifdef HAVE_LIBJPEG
+typedef struct
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+} ImgJpegError;
+
+static void gtk_timeline_jpeg_error_exit(j_common_ptr cinfo)
+{
+  ImgJpegError *err = (ImgJpegError *)cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+static void gtk_timeline_jpeg_output_message(j_common_ptr cinfo)
+{
+}
+
+static GdkPixbuf *gtk_timeline_thumbnail_decode_jpeg(const gchar *filename, gint size)
+{
+  struct jpeg_decompress_struct cinfo;
+  ImgJpegError jerr;
+  GdkPixbuf *volatile decoded = NULL;
+  GdkPixbuf *pix = NULL;
+  guchar *volatile gray = NULL;
+  JSAMPROW row;
+  guchar *pixels;
+  gint box_width, box_height, denom, rowstride;
+  guint x;
+  FILE *fp;
+
+  fp = g_fopen(filename, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = gtk_timeline_jpeg_error_exit;
+  jerr.pub.output_message = gtk_timeline_jpeg_output_message;
+  if (setjmp(jerr.setjmp_buffer))
+  {
+    //Not a JPEG or a broken one, let GdkPixbuf have a go
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    if (decoded)
+      g_object_unref(decoded);
+    g_free(gray);
+    return NULL;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+
+  //CMYK and friends are left to GdkPixbuf
+  if (cinfo.jpeg_color_space != JCS_GRAYSCALE && cinfo.jpeg_color_space != JCS_YCbCr && cinfo.jpeg_color_space != JCS_RGB)
+  {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return NULL;
+  }
+
+  //Let the IDCT scale down by the largest factor still giving at least the box size
+  gtk_timeline_thumbnail_box(cinfo.image_width, cinfo.image_height, size, &box_width, &box_height);
+  for (denom = 8; denom > 1; denom /= 2)
+    if ((cinfo.image_width + denom - 1) / denom >= (guint)box_width && (cinfo.image_height + denom - 1) / denom >= (guint)box_height)
+      break;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.dct_method = JDCT_IFAST;
+  cinfo.do_fancy_upsampling = FALSE;
+  cinfo.out_color_space = cinfo.jpeg_color_space == JCS_GRAYSCALE ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+
+  decoded = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, cinfo.output_width, cinfo.output_height);
+  if (decoded == NULL)
+    longjmp(jerr.setjmp_buffer, 1);
+  pixels = gdk_pixbuf_get_pixels(decoded);
+  rowstride = gdk_pixbuf_get_rowstride(decoded);
+  if (cinfo.output_components == 1)
+    gray = g_malloc(cinfo.output_width);
+
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    guchar *dest = pixels + (gsize)cinfo.output_scanline * rowstride;
+
+    row = gray ? gray : dest;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    if (gray)
+      for (x = 0; x < cinfo.output_width; x++)
+        dest[3 * x] = dest[3 * x + 1] = dest[3 * x + 2] = gray[x];
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+  g_free(gray);
+
+  pix = gtk_timeline_thumbnail_fit(decoded, box_width, box_height);
+  g_object_unref(decoded);
+  return pix;
+}
+#endif
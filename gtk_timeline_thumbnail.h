@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2021 Giuseppe Torelli <colossus73@gmail.com>
+ *   *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License,or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not,write to the Free Software
+ *  Foundation,Inc.,59 Temple Place - Suite 330,Boston,MA 02111-1307,USA.
+ *
+ */
+
+#ifndef __GTK_TIMELINE_THUMBNAIL_H__
+#define __GTK_TIMELINE_THUMBNAIL_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  IMG_THUMBNAIL_DECODE_AUTO,
+  IMG_THUMBNAIL_DECODE_EXIF,
+  IMG_THUMBNAIL_DECODE_JPEG_SCALED,
+  IMG_THUMBNAIL_DECODE_GDK_PIXBUF
+} ImgThumbnailDecode;
+
+//Thumbnails are shared with the other applications through the freedesktop.org
+//cache, ~/.cache/thumbnails/normal/<md5 of the uri>.png, validated against the
+//mtime and the size of the source file.
+GdkPixbuf *gtk_timeline_thumbnail_load			(const gchar *filename, gint height, GCancellable *cancellable);
+GdkPixbuf *gtk_timeline_thumbnail_cache_lookup	(const gchar *filename, gint height);
+void gtk_timeline_thumbnail_cache_store			(const gchar *filename, GdkPixbuf *pix);
+
+//Decodes filename to fit a size x size box. IMG_THUMBNAIL_DECODE_AUTO tries the
+//EXIF preview, then a 1/2, 1/4 or 1/8 scaled JPEG decode, then GdkPixbuf.
+GdkPixbuf *gtk_timeline_thumbnail_decode		(const gchar *filename, gint size, ImgThumbnailDecode method);
+
+G_END_DECLS
+
+#endif
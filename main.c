@@ -18,17 +18,36 @@
  */
 
 /*
-    gcc -Wall gtk_timeline.c main.c -o timeline `pkg-config gtk+-3.0 --cflags --libs` -lm
+    cmake -S . -B build && cmake --build build && ./build/timeline
+    or
+    gcc -Wall gtk_timeline.c gtk_timeline_thumbnail.c gtk_timeline_clips.c gtk_timeline_audio.c gtk_timeline_project.c main.c -o timeline `pkg-config gtk+-3.0 --cflags --libs` -lm
 */
 
 #include <gtk/gtk.h>
 #include "gtk_timeline.h"
+#include "gtk_timeline_project.h"
 #include <stdlib.h>
 
+//Each strip of the export goes to its own PNG, prefix-0000.png and on
+static gboolean write_strip(cairo_surface_t *strip, gint x, gpointer user_data, GError **error)
+{
+  static gint n = 0;
+  gchar *filename;
+  cairo_status_t status;
+
+  filename = g_strdup_printf("%s-%04d.png", (const gchar*)user_data, n++);
+  status = cairo_surface_write_to_png(strip, filename);
+  if (status != CAIRO_STATUS_SUCCESS)
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s: %s", filename, cairo_status_to_string(status));
+  g_free(filename);
+
+  return status == CAIRO_STATUS_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
+  //Clips are moved inside the timeline by the widget itself, only files are dropped
   static GtkTargetEntry drop_target[] = {
-      { "GTK_TIMELINE_SLIDE", GTK_TARGET_SAME_APP, 0 },
       {"text/uri-list", 0, 0}
     };
   gtk_init(&argc, &argv);
@@ -44,6 +63,12 @@ int main(int argc, char *argv[])
   g_object_set(timeline, "total_time",        300, NULL);
   g_object_set(timeline, "video_background", "#0084ff", NULL);
   g_object_set(timeline, "audio_background", "#0084ff", NULL);
+  //Flash the repainted areas
+  if (g_getenv("TIMELINE_DEBUG_DAMAGE"))
+    g_object_set(timeline, "debug_damage", TRUE, NULL);
+  //Show the draw, decode and cache stats over the timeline
+  if (g_getenv("TIMELINE_STATS"))
+    g_object_set(timeline, "stats_overlay", TRUE, NULL);
 
   gtk_widget_add_events( timeline, 
                            GDK_BUTTON1_MOTION_MASK
@@ -52,21 +77,50 @@ int main(int argc, char *argv[])
                          | GDK_BUTTON_RELEASE_MASK
                          | GDK_SCROLL_MASK
                          | GDK_KEY_PRESS_MASK );
-  GtkWidget *viewport = gtk_viewport_new(NULL,NULL);
   GtkWidget *scrolledwindow1 = gtk_scrolled_window_new(NULL, NULL);
-  g_signal_connect(G_OBJECT(timeline), "scroll-event",      G_CALLBACK(gtk_timeline_scroll), viewport);
+  g_signal_connect(G_OBJECT(timeline), "scroll-event",      G_CALLBACK(gtk_timeline_scroll), NULL);
   g_signal_connect(G_OBJECT(timeline), "drag-data-received",G_CALLBACK(gtk_timeline_drag_data_received), NULL);
   g_signal_connect(G_OBJECT(timeline), "button-press-event",G_CALLBACK(gtk_timeline_mouse_button_press), NULL);
-  //g_signal_connect(G_OBJECT(timeline), "motion-notify-event",G_CALLBACK(gtk_timeline_motion_notify), NULL);
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolledwindow1), GTK_POLICY_ALWAYS, GTK_POLICY_NEVER);
   
-  gtk_container_add (GTK_CONTAINER(viewport), timeline);
-  gtk_container_add (GTK_CONTAINER(scrolledwindow1), viewport);
+  //The timeline is scrollable itself, no viewport
+  gtk_container_add (GTK_CONTAINER(scrolledwindow1), timeline);
   gtk_container_add (GTK_CONTAINER (window), scrolledwindow1);
-  gtk_timeline_add_slide(timeline, "landscape.jpg", 0);
-  gtk_timeline_add_slide(timeline, "cappuccetto_rosso.jpg", 0);
-  gtk_timeline_add_slide(timeline, "landscape_grass_river.jpg", 0);
-  //gtk_timeline_add_slide(timeline, "file_not_found.jpg", 0);
+  //./timeline project.txt opens a saved project instead of the sample slides
+  if (argc > 1)
+  {
+    GError *error = NULL;
+
+    if ( ! gtk_timeline_project_load_from_file((ImgTimeline*)timeline, argv[1], &error))
+    {
+      g_printerr("%s: %s\n", argv[1], error->message);
+      g_error_free(error);
+    }
+  }
+  else
+  {
+    gtk_timeline_add_slide(timeline, "landscape.jpg", 0);
+    gtk_timeline_add_slide(timeline, "cappuccetto_rosso.jpg", 0);
+    gtk_timeline_add_slide(timeline, "landscape_grass_river.jpg", 0);
+    //gtk_timeline_add_slide(timeline, "file_not_found.jpg", 0);
+  }
+  //TIMELINE_EXPORT=strip ./timeline writes the whole timeline to strip-0000.png and on, without showing it
+  if (g_getenv("TIMELINE_EXPORT"))
+  {
+    GError *error = NULL;
+    gdouble pixels_per_second;
+    gint64 duration;
+
+    g_object_get(timeline, "duration", &duration, "pixels_per_second", &pixels_per_second, NULL);
+    if ( ! gtk_timeline_render_strips((ImgTimeline*)timeline, 0, duration, pixels_per_second, 2048,
+                                      write_strip, (gpointer)g_getenv("TIMELINE_EXPORT"), NULL, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return 1;
+    }
+    return 0;
+  }
   gtk_widget_show_all(window);
 
   gtk_main();